@@ -0,0 +1,24 @@
+// buddyinfo
+// Print how many free blocks of each order the kernel's page
+// allocator has, to watch physical memory fragmentation.
+
+#include "types.h"
+#include "user.h"
+
+#define NORDER 16
+
+int
+main(void)
+{
+  int counts[NORDER];
+  int i, n;
+
+  if((n = buddyinfo(counts, NORDER)) < 0){
+    printf(2, "buddyinfo failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++)
+    printf(1, "order %d (%d KB): %d free\n", i, 4 << i, counts[i]);
+  printf(1, "free pages %d\n", freemem());
+  exit();
+}
@@ -2,13 +2,17 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmem_cache;
 struct pipe;
 struct proc;
+struct rb_node;
+struct rb_root;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
 
 // bio.c
 void            binit(void);
@@ -68,7 +72,10 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
-extern int      freemems; //Free page
+int             freemem(void);
+char*           kalloc_pages(int);
+void            kfree_pages(char*, int);
+int             buddyinfo(uint, int);
 
 // kbd.c
 void            kbdintr(void);
@@ -79,7 +86,11 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
+void            lapiconeshot(uint);
 void            lapicstartap(uchar, uint);
+uint            mticks_consume(uint64*);
+uint            mticks_since(uint64);
 void            microdelay(int);
 
 // log.c
@@ -97,6 +108,7 @@ void            picenable(int);
 void            picinit(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
@@ -115,16 +127,40 @@ void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+void            setpname(char*);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+int             sleep_timeout(void*, struct spinlock*, uint);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+void            wakeup_one(void*);
 void            yield(void);
+void            preempt_disable(void);
+void            preempt_enable(void);
+int             resched_pending(void);
 int             getpname(int);
 int             getnice(int);
 int             setnice(int,int);
+int             sched_setscheduler(int, int, int);
+int             sched_setaffinity(int, uint);
+int             sched_getaffinity(int);
+int             sched_groupctl(int, int, int, int);
+int             sched_setgroup(int, int);
+int             setmaxproc(int);
 void            ps(int);
+void            load_balance(void);
+int             idletime(int);
+int             schedstat(uint, int);
+uint64          calc_delta_fair(uint, struct proc*);
+void            update_curr(struct proc*);
+
+// rbtree.c
+void            rb_link_node(struct rb_node*, struct rb_node*, struct rb_node**);
+void            rb_insert_color(struct rb_node*, struct rb_root*);
+void            rb_erase(struct rb_node*, struct rb_root*);
+struct rb_node* rb_first(struct rb_root*);
+struct rb_node* rb_next(struct rb_node*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -134,10 +170,17 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstat(uint, int);
+void            latencydump(void);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// slab.c
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -163,12 +206,16 @@ void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+void            add_timer(struct timer*);
+int             del_timer(struct timer*);
+void            run_timers(void);
 
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
+void            set_next_event(uint);
 
 // uart.c
 void            uartinit(void);
@@ -177,6 +224,7 @@ void            uartputc(int);
 
 // vm.c
 void            seginit(void);
+void            mmapinit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
@@ -192,9 +240,13 @@ int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
 uint            mmap(uint, int, int, int, int, int);
 int             page_fault_handler(uint, int);
+int             lazyfault(struct proc*, uint);
+int             lazyfault_range(struct proc*, uint, uint);
+void            lazyrelease(pde_t*, uint, uint);
+extern uint     untouched;
 int             munmap(uint);
-int             freemem();
 int             map_fork(struct proc *);
+void            map_exit(struct proc *);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -9,17 +9,22 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
 
 struct devsw devsw[NDEV];
+// File structures come from filecache; ftable.lock guards their
+// reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
 } ftable;
 
+static struct kmem_cache filecache;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  kmem_cache_init(&filecache, "filecache", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -28,16 +33,11 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = kmem_cache_alloc(&filecache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -69,6 +69,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  kmem_cache_free(&filecache, f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
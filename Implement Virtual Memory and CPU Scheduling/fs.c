@@ -14,12 +14,13 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
@@ -159,24 +160,28 @@ bfree(int dev, uint b)
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
 //
+// Entries come from inodecache as needed, so the number of
+// referenced inodes has no fixed limit. Unreferenced entries are
+// kept for reuse, but only up to NINODE entries in all; beyond that
+// iput() frees an entry when its last reference goes.
+//
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *list; // All entries, linked by next
+  int n;              // Entries in list
 } icache;
 
+static struct kmem_cache inodecache;
+
 void
 iinit(int dev)
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  kmem_cache_init(&inodecache, "inodecache", sizeof(struct inode));
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -247,7 +252,7 @@ iget(uint dev, uint inum)
 
   // Is the inode already cached?
   empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+  for(ip = icache.list; ip; ip = ip->next){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&icache.lock);
@@ -257,9 +262,15 @@ iget(uint dev, uint inum)
       empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+  // Recycle an inode cache entry, or add one.
+  if(empty == 0){
+    if((empty = kmem_cache_alloc(&inodecache)) == 0)
+      panic("iget: no inodes");
+    initsleeplock(&empty->lock, "inode");
+    empty->next = icache.list;
+    icache.list = empty;
+    icache.n++;
+  }
 
   ip = empty;
   ip->dev = dev;
@@ -331,6 +342,8 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  struct inode **pp;
+
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
     acquire(&icache.lock);
@@ -348,6 +361,16 @@ iput(struct inode *ip)
 
   acquire(&icache.lock);
   ip->ref--;
+  if(ip->ref == 0 && icache.n > NINODE){
+    // Too many entries cached: free this one.
+    for(pp = &icache.list; *pp != ip; pp = &(*pp)->next)
+      ;
+    *pp = ip->next;
+    icache.n--;
+    release(&icache.lock);
+    kmem_cache_free(&inodecache, ip);
+    return;
+  }
   release(&icache.lock);
 }
 
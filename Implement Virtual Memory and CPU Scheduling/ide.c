@@ -5,10 +5,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -53,6 +53,8 @@ ideinit(void)
   int i;
 
   initlock(&idelock, "ide");
+  // Disk interrupts go to the last CPU; I/O-bound daemons can
+  // sched_setaffinity() themselves there (taskset ide).
   ioapicenable(IRQ_IDE, ncpu - 1);
   idewait(0);
 
@@ -1,6 +1,14 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, or physically
+// contiguous blocks of 2^order pages (kalloc_pages).
+//
+// Free memory in [end, PHYSTOP) is kept by a binary buddy allocator:
+// a free block of order o is 2^o pages aligned to its own size in
+// physical memory, and its buddy is the block whose address differs
+// only in the bit worth PGSIZE << o. Freeing a block whose buddy is
+// free too merges the two into one block of order o + 1, up to
+// MAXORDER.
 
 #include "types.h"
 #include "defs.h"
@@ -8,24 +16,47 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "proc.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
-int freemems;      // Current number of free memory page
 
 struct run
 {
   struct run *next;
+  struct run *prev; // buddy free list에서만 씀
 };
 
 struct
 {
   struct spinlock lock; // 사용할거면 이거 써
   int use_lock;         // lock을 사용할 거야?
-  struct run *freelist;
+  struct run *freelist[MAXORDER + 1]; // order별 free block 리스트
+  int nblocks[MAXORDER + 1];          // order별 free block 수
+  int nfree;                          // buddy에 있는 free page 수
 } kmem;
 
+// For each physical page, 1 + the order of the free block that
+// starts there, or 0 if no free block starts there (kmem.lock).
+static uchar korder[PHYSTOP / PGSIZE];
+
+// Each CPU keeps a magazine of free pages in front of the buddy
+// allocator, so most kalloc() and kfree() calls only disable
+// interrupts. An empty magazine is refilled, and one holding more
+// than KMAGAZINE pages is drained, KBATCH pages at a time under
+// kmem.lock. Pages left in other CPUs' magazines are not stolen
+// when the buddy allocator runs out; at most ncpu * KMAGAZINE are
+// idle there.
+#define KBATCH 16
+#define KMAGAZINE (2 * KBATCH)
+
+struct kcpu
+{
+  struct run *list;
+  int n; // Pages in list; changes across CPUs only under kmem.lock
+} kcpu[NCPU];
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -56,6 +87,111 @@ void freerange(void *vstart, void *vend)
   for (; p + PGSIZE <= (char *)vend; p += PGSIZE)
     kfree(p);
 }
+
+// Put free block r of the given order on its list.
+static void
+free_add(struct run *r, int order)
+{
+  r->prev = 0;
+  r->next = kmem.freelist[order];
+  if (r->next)
+    r->next->prev = r;
+  kmem.freelist[order] = r;
+  kmem.nblocks[order]++;
+  korder[V2P(r) / PGSIZE] = order + 1;
+}
+
+// Take free block r of the given order off its list.
+static void
+free_del(struct run *r, int order)
+{
+  if (r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist[order] = r->next;
+  if (r->next)
+    r->next->prev = r->prev;
+  kmem.nblocks[order]--;
+  korder[V2P(r) / PGSIZE] = 0;
+}
+
+// Allocate a block of 2^order pages, splitting the smallest free
+// block big enough and freeing the halves not used.
+static struct run *
+buddy_alloc(int order)
+{
+  struct run *r;
+  int o;
+
+  for (o = order; o <= MAXORDER && kmem.freelist[o] == 0; o++)
+    ;
+  if (o > MAXORDER)
+    return 0;
+  r = kmem.freelist[o];
+  free_del(r, o);
+  // 남는 뒤쪽 절반은 한 단계 작은 free block으로
+  while (o > order)
+  {
+    o--;
+    free_add((struct run *)((char *)r + (PGSIZE << o)), o);
+  }
+  kmem.nfree -= 1 << order;
+  return r;
+}
+
+// Free a block of 2^order pages, merging it with its buddy
+// for as long as the buddy is free as a whole.
+static void
+buddy_free(struct run *r, int order)
+{
+  uint pa = V2P(r), buddy;
+
+  kmem.nfree += 1 << order;
+  while (order < MAXORDER)
+  {
+    buddy = pa ^ (PGSIZE << order);
+    if (buddy >= PHYSTOP || korder[buddy / PGSIZE] != order + 1)
+      break;
+    free_del((struct run *)P2V(buddy), order);
+    pa &= buddy;
+    order++;
+  }
+  free_add((struct run *)P2V(pa), order);
+}
+
+// Give KBATCH pages of this CPU's magazine m back to the buddy allocator.
+static void
+drain(struct kcpu *m)
+{
+  struct run *r;
+  int i;
+
+  acquire(&kmem.lock);
+  for (i = 0; i < KBATCH && (r = m->list) != 0; i++)
+  {
+    m->list = r->next;
+    m->n--;
+    buddy_free(r, 0);
+  }
+  release(&kmem.lock);
+}
+
+// Take up to KBATCH single pages from the buddy allocator into magazine m.
+static void
+refill(struct kcpu *m)
+{
+  struct run *r;
+  int i;
+
+  acquire(&kmem.lock);
+  for (i = 0; i < KBATCH && (r = buddy_alloc(0)) != 0; i++)
+  {
+    r->next = m->list;
+    m->list = r;
+    m->n++;
+  }
+  release(&kmem.lock);
+}
 // PAGEBREAK: 21
 //  Free the page of physical memory pointed at by v,
 //  which normally should have been returned by a
@@ -64,6 +200,7 @@ void freerange(void *vstart, void *vend)
 void kfree(char *v)
 {
   struct run *r;
+  struct kcpu *m;
 
   if ((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
@@ -71,14 +208,21 @@ void kfree(char *v)
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
-  if (kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run *)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  freemems++; // Free page number Increase
-  if (kmem.use_lock)
-    release(&kmem.lock);
+  // 부팅 중(kinit1, kinit2)에는 buddy에 바로
+  if (!kmem.use_lock)
+  {
+    buddy_free(r, 0);
+    return;
+  }
+  pushcli();
+  m = &kcpu[cpuid()];
+  r->next = m->list;
+  m->list = r;
+  m->n++;
+  if (m->n > KMAGAZINE)
+    drain(m);
+  popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -88,14 +232,93 @@ char *
 kalloc(void)
 {
   struct run *r;
+  struct kcpu *m;
+
+  if (!kmem.use_lock)
+    return (char *)buddy_alloc(0);
+  pushcli();
+  m = &kcpu[cpuid()];
+  if (m->list == 0)
+    refill(m);
+  r = m->list;
+  if (r)
+  {
+    m->list = r->next;
+    m->n--;
+  }
+  popcli();
+  return (char *)r;
+}
 
+// Allocate 2^order physically contiguous pages, aligned to their
+// size. Returns 0 if no free block that large is left.
+char *
+kalloc_pages(int order)
+{
+  struct run *r;
+
+  if (order < 0 || order > MAXORDER)
+    return 0;
+  if (order == 0)
+    return kalloc();
   if (kmem.use_lock)
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if (r)
-    kmem.freelist = r->next;
-  freemems--; // Free page number decrease
+  r = buddy_alloc(order);
   if (kmem.use_lock)
     release(&kmem.lock);
   return (char *)r;
 }
+
+// Free 2^order pages at v, as returned by kalloc_pages(order).
+void kfree_pages(char *v, int order)
+{
+  if (order < 0 || order > MAXORDER || V2P(v) % (PGSIZE << order) ||
+      v < end || V2P(v) + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_pages");
+  if (order == 0)
+  {
+    kfree(v);
+    return;
+  }
+
+  // Fill with junk to catch dangling refs.
+  memset(v, 1, PGSIZE << order);
+
+  if (kmem.use_lock)
+    acquire(&kmem.lock);
+  buddy_free((struct run *)v, order);
+  if (kmem.use_lock)
+    release(&kmem.lock);
+}
+
+// Number of free pages: the buddy allocator's plus every CPU's
+// magazine. Batches move under kmem.lock, so only pages being
+// allocated or freed right now on other CPUs can be miscounted.
+int freemem(void)
+{
+  int n, i;
+
+  acquire(&kmem.lock);
+  n = kmem.nfree;
+  for (i = 0; i < ncpu; i++)
+    n += kcpu[i].n;
+  release(&kmem.lock);
+  return n;
+}
+
+// Copy the number of free blocks of each order, 0 up to MAXORDER
+// or n - 1, to user address addr. Pages in the per-CPU magazines
+// are not counted. Returns the number of orders copied, or -1.
+int buddyinfo(uint addr, int n)
+{
+  int counts[MAXORDER + 1];
+
+  if (n > MAXORDER + 1)
+    n = MAXORDER + 1;
+  acquire(&kmem.lock);
+  memmove(counts, kmem.nblocks, sizeof(counts));
+  release(&kmem.lock);
+  if (copyout(myproc()->pgdir, addr, counts, n * sizeof(int)) < 0)
+    return -1;
+  return n;
+}
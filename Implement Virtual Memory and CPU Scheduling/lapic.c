@@ -43,6 +43,11 @@
 
 volatile uint *lapic;  // Initialized in mp.c
 
+#define TICR_TICK 10000000  // Timer counts per tick
+
+uint tsc_per_mtick;     // TSC cycles per millitick (1/1000 tick)
+static uint mtick_mult; // 2^32 / tsc_per_mtick
+
 //PAGEBREAK!
 static void
 lapicw(int index, int value)
@@ -51,6 +56,24 @@ lapicw(int index, int value)
   lapic[ID];  // wait for write to finish, by reading
 }
 
+// Measure the TSC against the timer, which counts
+// TICR_TICK per tick, by timing a tenth of a tick.
+static void
+tsccalibrate(void)
+{
+  uint64 t0;
+
+  lapicw(TIMER, MASKED);
+  lapicw(TICR, TICR_TICK / 10);
+  t0 = rdtsc();
+  while(lapic[TCCR] != 0)
+    ;
+  tsc_per_mtick = (uint)(rdtsc() - t0) / 100;
+  if(tsc_per_mtick == 0)
+    tsc_per_mtick = 1;
+  mtick_mult = 0xFFFFFFFF / tsc_per_mtick;
+}
+
 void
 lapicinit(void)
 {
@@ -60,13 +83,16 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down at bus frequency from lapic[TICR]
+  // and then issues an interrupt once (one-shot mode).
+  // Each CPU re-arms it with lapiconeshot() for its next
+  // event; see set_next_event() in trap.c. The first
+  // interrupt comes one tick from now.
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  if(tsc_per_mtick == 0)
+    tsccalibrate();
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  lapicw(TICR, TICR_TICK);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -113,6 +139,48 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Interrupt this CPU once, mticks milliticks from now.
+// 0 disarms the timer.
+void
+lapiconeshot(uint mticks)
+{
+  if(!lapic)
+    return;
+  if(mticks > 100000)
+    mticks = 100000;
+  lapicw(TICR, mticks * (TICR_TICK / 1000));
+}
+
+// Whole milliticks since TSC value stamp, on this CPU.
+uint
+mticks_since(uint64 stamp)
+{
+  return ((rdtsc() - stamp) * mtick_mult) >> 32;
+}
+
+// Like mticks_since(), but also move stamp forward by the
+// milliticks returned, so the remainder counts next time.
+uint
+mticks_consume(uint64 *stamp)
+{
+  uint n = mticks_since(*stamp);
+
+  *stamp += (uint64)n * tsc_per_mtick;
+  return n;
+}
+
+// Send interrupt vector to the CPU with the given APIC ID.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -0,0 +1,68 @@
+// lockstat [command [args]]
+// With no argument, print how often each kind of spinlock has been
+// taken, how often that meant waiting, and for how long. Given a
+// command, run it and print only what changed while it ran.
+// Needs a kernel built with LOCKSTAT=1.
+
+#include "types.h"
+#include "user.h"
+#include "lockstat.h"
+
+#define NSTAT 64
+
+struct lockstat before[NSTAT], after[NSTAT];
+
+// Print s, less what old already had (old may be 0).
+// Times are in units of 1024 TSC cycles.
+void
+print(struct lockstat *s, struct lockstat *old)
+{
+  struct lockstat zero;
+
+  if(old == 0){
+    memset(&zero, 0, sizeof(zero));
+    old = &zero;
+  }
+  if(s->acquire == old->acquire)
+    return;
+  printf(1, "%s acquire %d contended %d spin %d maxhold %d\n", s->name,
+         s->acquire - old->acquire, s->contended - old->contended,
+         (uint)((s->spin - old->spin) >> 10), (uint)(s->maxhold >> 10));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, m, i, j, pid;
+  struct lockstat *old;
+
+  if((n = lockstat(before, NSTAT)) < 0){
+    printf(2, "lockstat: kernel built without LOCKSTAT\n");
+    exit();
+  }
+  if(argc < 2){
+    for(i = 0; i < n; i++)
+      print(&before[i], 0);
+    exit();
+  }
+
+  if((pid = fork()) < 0){
+    printf(2, "lockstat: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    printf(2, "lockstat: exec %s failed\n", argv[1]);
+    exit();
+  }
+  wait();
+  m = lockstat(after, NSTAT);
+  for(i = 0; i < m; i++){
+    old = 0;
+    for(j = 0; j < n; j++)
+      if(strcmp(before[j].name, after[i].name) == 0)
+        old = &before[j];
+    print(&after[i], old);
+  }
+  exit();
+}
@@ -0,0 +1,13 @@
+// Spinlock contention statistics by lock name, as copied out by
+// lockstat(). Only counted in kernels built with LOCKSTAT=1 (Makefile).
+// Times are in TSC cycles.
+#define LOCKNAMESZ 16
+#define NLOCKSTAT 64 // Most lock names counted
+
+struct lockstat {
+  char name[LOCKNAMESZ];
+  uint acquire;   // Acquisitions
+  uint contended; // Acquisitions that had to wait
+  uint64 spin;    // Time spent waiting for it
+  uint64 maxhold; // Longest time held
+};
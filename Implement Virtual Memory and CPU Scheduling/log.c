@@ -162,8 +162,9 @@ end_op(void)
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+    // the amount of reserved space by one op's worth,
+    // so only one waiter can go ahead.
+    wakeup_one(&log);
   }
   release(&log.lock);
 
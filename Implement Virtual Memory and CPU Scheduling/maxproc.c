@@ -0,0 +1,25 @@
+// maxproc
+// maxproc n
+// Print the limit on processes, or set it to n. Fails if more
+// than n processes already exist.
+
+#include "types.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  if(argc == 1){
+    printf(1, "maxproc %d\n", setmaxproc(0));
+    exit();
+  }
+  if(argc != 2 || (n = atoi(argv[1])) <= 0){
+    printf(2, "usage: maxproc [n]\n");
+    exit();
+  }
+  if(setmaxproc(n) < 0)
+    printf(2, "maxproc: more than %d processes exist\n", n);
+  exit();
+}
@@ -1,9 +1,8 @@
-#define NPROC 64                  // maximum number of processes
+#define NPROC 64                  // default limit on processes (setmaxproc)
 #define KSTACKSIZE 4096           // size of per-process kernel stack
 #define NCPU 8                    // maximum number of CPUs
 #define NOFILE 16                 // open files per process
-#define NFILE 100                 // open files per system
-#define NINODE 50                 // maximum number of active i-nodes
+#define NINODE 50                 // i-nodes kept cached while unreferenced
 #define NDEV 10                   // maximum major device number
 #define ROOTDEV 1                 // device number of file system root disk
 #define MAXARG 32                 // max exec arguments
@@ -11,6 +10,15 @@
 #define LOGSIZE (MAXOPBLOCKS * 3) // max data blocks in on-disk log
 #define NBUF (MAXOPBLOCKS * 3)    // size of disk block cache
 #define FSSIZE 1000               // size of file system in blocks
+#define MAXORDER 10               // largest kalloc_pages() block: 2^MAXORDER pages (4MB)
+#define NSCHEDHIST 16             // buckets in the scheduling delay histogram
+#define SCHED_NORMAL 0            // CFS (sched_setscheduler policies)
+#define SCHED_FIFO 1              // real-time, run until block or preempt
+#define SCHED_RR 2                // real-time, round robin within priority
+#define SCHED_BATCH 3             // CFS, longer slices, never wakeup-preempts
+#define SCHED_IDLE 4              // runs only when nothing else can
+#define MAX_RT_PRIO 99            // real-time priorities are 1..MAX_RT_PRIO
+#define NSCHEDGROUP 8             // CPU bandwidth groups, including default group 0
 #define PROT_READ 0x1             // PA4
 #define PROT_WRITE 0x2            // PA4
 #define MAP_ANONYMOUS 0x1         // PA4
@@ -2,11 +2,12 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
 
 #define PIPESIZE 512
 
@@ -19,6 +20,14 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+static struct kmem_cache pipecache;
+
+void
+pipeinit(void)
+{
+  kmem_cache_init(&pipecache, "pipecache", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,7 +37,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)
+  if((p = kmem_cache_alloc(&pipecache)) == 0)
     goto bad;
   p->readopen = 1;
   p->writeopen = 1;
@@ -48,7 +57,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    kmem_cache_free(&pipecache, p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -69,7 +78,7 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    kmem_cache_free(&pipecache, p);
   } else
     release(&p->lock);
 }
@@ -84,6 +93,8 @@ pipewrite(struct pipe *p, char *addr, int n)
   for(i = 0; i < n; i++){
     while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
+        // Pass on the wakeup piperead() may have given us.
+        wakeup_one(&p->nwrite);
         release(&p->lock);
         return -1;
       }
@@ -115,7 +126,7 @@ piperead(struct pipe *p, char *addr, int n)
       break;
     addr[i] = p->data[p->nread++ % PIPESIZE];
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  wakeup_one(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
   return i;
 }
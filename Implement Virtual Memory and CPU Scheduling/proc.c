@@ -4,8 +4,12 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
+#include "traps.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "schedstat.h"
+#include "slab.h"
 
 // weights[nice] => 해당 nice값에 대응되는 가중치
 int weights[] = {
@@ -58,23 +62,1187 @@ int weights[] = {
     18,
     15,
 };
+// inv_weights[nice] => 2^32 / weights[nice], so that the tick path
+// can scale runtime by a multiply and a shift instead of dividing.
+static const uint inv_weights[] = {
+    /*0*/
+    48388,
+    59856,
+    76040,
+    92818,
+    118348,
+    /*5*/
+    147320,
+    184698,
+    229616,
+    287308,
+    360437,
+    /*10*/
+    449829,
+    563644,
+    704093,
+    875809,
+    1099582,
+    /*15*/
+    1376151,
+    1717300,
+    2157191,
+    2708050,
+    3363326,
+    /*20*/
+    4194304,
+    5237765,
+    6557202,
+    8165337,
+    10153587,
+    /*25*/
+    12820798,
+    15790321,
+    19976592,
+    24970740,
+    31350126,
+    /*30*/
+    39045157,
+    49367440,
+    61356676,
+    76695844,
+    95443717,
+    /*35*/
+    119304647,
+    148102320,
+    186737708,
+    238609294,
+    286331153,
+};
+#define NICE_0_WEIGHT 1024 // weights[20]
+#define WMULT_SHIFT 32     // inv_weights[] are scaled by 2^WMULT_SHIFT
+// vruntime is a 64-bit fixed-point count of milliticks
+// with VRUNTIME_SHIFT fractional bits.
+#define VRUNTIME_SHIFT 10
+// Scheduling period in milliticks, split among the runnable
+// processes of a CPU in proportion to their weights.
+#define SCHED_LATENCY 10000
+// How far (in milliticks of its runtime) a woken process's vruntime
+// must be below the running process's to preempt it. Larger than the
+// one tick of credit waitq_wake() gives, so it only preempts a process
+// that has run well past min_vruntime.
+#define WAKEUP_GRANULARITY 2000
+// Shortest timeslice, however many processes share the period.
+#define SCHED_MIN_GRANULARITY 1000
+// Shortest timeslice of a SCHED_BATCH process.
+#define BATCH_MIN_GRANULARITY 5000
+// Real-time processes may use at most RT_RUNTIME milliticks of each
+// RT_PERIOD ticks on a CPU while CFS processes are waiting there.
+#define RT_PERIOD 100
+#define RT_RUNTIME 95000
+// Timeslice of SCHED_RR processes, in milliticks.
+#define RR_TIMESLICE 10000
+// Milliticks after a process last ran during which its cache
+// is taken to still be warm on that CPU.
+#define MIGRATION_COST 500
+// Ticks between two periodic load_balance() passes on a CPU.
+#define BALANCE_INTERVAL 10
+// Longest bandwidth group period, in ticks. A quota of up to
+// GROUP_MAX_PERIOD * NCPU ticks still fits in uint milliticks.
+#define GROUP_MAX_PERIOD 100000
+
+// CPU bandwidth groups. A group's RUNNABLE CFS processes on a CPU
+// are queued on its group_rq for that CPU, ordered by vruntime, and
+// the CPU's runqueue orders the group_rqs by a group vruntime that
+// advances with runtime scaled by the group's shares. The picker
+// takes the group with the smallest group vruntime, then its process
+// with the smallest vruntime, so the CPU is shared fairly between
+// groups first and then between the processes of each group.
+//
+// A group with a quota may run quota milliticks of every period
+// ticks, summed over all CPUs; after that it is throttled, and its
+// processes stay queued but are not picked until the period ends.
+//
+// Group 0 holds every process that has not joined another group.
+struct group_rq
+{
+  struct sched_group *sg;   // group this is the per-CPU part of
+  struct rb_root root;      // RUNNABLE processes keyed on vruntime
+  struct rb_node *leftmost; // cached node with the smallest vruntime
+  uint total_weight;        // sum of weights of queued processes
+  int nr_running;           // number of queued processes
+  uint64 min_vruntime;      // monotonic floor of vruntime in the group
+  struct rb_node rb;        // node in the runqueue's tree
+  uint64 vruntime;          // group vruntime on this CPU
+  int on_rq;                // rb is in the runqueue's tree
+  int curr;                 // one of its processes is running
+};
+
+struct sched_group
+{
+  struct spinlock lock;     // protects the bandwidth fields below
+  int used;                 // set up (group 0 always is)
+  uint shares;              // weight against the other groups
+  uint inv_shares;          // 2^32 / shares
+  uint quota;               // milliticks per period, 0 for no limit
+  uint period;              // ticks
+  uint runtime;             // milliticks used in this period
+  uint period_end;          // tick the current period ends
+  int throttled;            // quota used up until the period ends
+  int timer_armed;          // unthrottle is pending
+  struct timer unthrottle;  // fires at period_end once throttled
+  struct group_rq grq[NCPU];
+};
+
+static struct sched_group groups[NSCHEDGROUP];
+
+// Per-CPU runqueue. RUNNABLE SCHED_FIFO/SCHED_RR processes are
+// kept in one list per priority and always run before the CFS
+// (SCHED_NORMAL and SCHED_BATCH) processes, which are kept per
+// group (see group_rq above). SCHED_IDLE processes are kept in a
+// tree of their own, ordered by vruntime, and only run when no
+// other process can.
+// The process a CPU is running is taken off the runqueue, and
+// so is its group_rq, and both are put back when it stops running.
+//
+// rq->lock protects the trees, the counters and the state of the
+// processes on them. It is also the lock held across swtch() between
+// a process and its CPU's scheduler, so sched() must be called
+// holding this CPU's rq->lock and nothing else. Lock order is
+// ptable.lock before a wait queue's lock before p->lock before
+// rq->lock before a sched_group's lock.
+struct runqueue
+{
+  struct spinlock lock;
+  struct rb_root root;      // group_rqs with RUNNABLE processes
+  struct rb_node *leftmost; // cached node with the smallest group vruntime
+  uint total_weight;        // sum of shares of queued group_rqs
+  int nr_running;           // number of queued processes
+  uint64 min_vruntime;      // monotonic floor of group vruntime on this CPU
+  struct group_rq *curr_grq; // group_rq of the running CFS process
+  struct rb_root idle_root;      // RUNNABLE SCHED_IDLE processes
+  struct rb_node *idle_leftmost;
+  uint idle_weight;              // sum of their weights
+  uint64 idle_min_vruntime;      // monotonic floor of their vruntime
+  uint next_balance;        // tick of the next periodic load_balance()
+  // Real-time processes, FIFO order within each priority.
+  struct proc *rt_head[MAX_RT_PRIO + 1];
+  struct proc *rt_tail[MAX_RT_PRIO + 1];
+  uint rt_bitmap[(MAX_RT_PRIO + 32) / 32]; // priorities with a list
+  int rt_nr_running;                       // queued real-time processes
+  uint rt_time;       // real-time runtime this period, in milliticks
+  uint rt_period_end; // tick the current RT_PERIOD ends
+};
+
+struct runqueue runqueues[NCPU];
+
+// Sleeping processes are kept on wait queues hashed by chan,
+// so wakeup() only looks at processes that may be sleeping on it.
+// Each queue has its own lock, which sleep() holds from releasing
+// the caller's lock until the process is on the queue, so sleep and
+// wakeup on different channels don't contend. A process's state and
+// chan change to and from SLEEPING under both its queue's lock and
+// p->lock, so either is enough to read them.
+#define WAITQ_SHIFT 6
+#define NWAITQ (1 << WAITQ_SHIFT)
+
+struct waitqueue
+{
+  struct spinlock lock;
+  struct proc *head; // longest sleeper first
+  struct proc *tail;
+};
+
+static struct waitqueue waitqs[NWAITQ];
+
+// ptable.lock serializes taking and freeing descriptors and guards
+// the parent/child lists (fork, exit, wait) and the pid hash. Lookups
+// that only read, like ps() and getpname(), take no lock: they copy
+// the process with proc_snapshot() and retry if its seq changed
+// meanwhile, and find_proc() does the same with pidseq.
+//
+// Descriptors come from proccache on demand (proc_cache_grow) up to
+// maxproc in use at once. wait() puts a reaped one back on the free
+// list, but never back into proccache: a struct proc pointer stays a
+// struct proc, which is what lets the lock-free readers follow stale
+// pointers safely. For the same reason the list of all descriptors
+// only ever grows at its head.
+#define PIDHASH_SHIFT 6
+#define NPIDHASH (1 << PIDHASH_SHIFT)
+
 struct
 {
-  struct spinlock lock;    // Lock Information
-  struct proc proc[NPROC]; // 최대 프로세스 개수(NPROC)만큼의 PCB 공간
+  struct spinlock lock; // Lock Information
+  struct proc *all;     // 지금까지 만든 모든 PCB, allnext로 연결
+  struct proc *free;    // UNUSED PCB, freenext로 연결
+  int nalloc;           // 만든 PCB 개수
+  int nproc;            // 사용 중인 PCB 개수
+  int maxproc;          // nproc 상한 (setmaxproc), 기본 NPROC
+  struct proc *pidhash[NPIDHASH]; // pid -> proc chains, linked by pidnext
+  uint pidseq;                    // Odd while a chain changes
 } ptable;
 
+static struct kmem_cache proccache;
+
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+static void kick_idle(struct runqueue *rq);
+static void check_preempt_wakeup(struct runqueue *rq, struct proc *p);
+static struct runqueue *select_rq(struct proc *p);
+int compare_vruntime(struct proc *p1, struct proc *p2);
+
+// Virtual runtime for delta milliticks of actual runtime by p:
+// delta * NICE_0_WEIGHT / weight, in vruntime fixed point.
+uint64
+calc_delta_fair(uint delta, struct proc *p)
+{
+  return ((uint64)delta * NICE_0_WEIGHT * inv_weights[p->nice]) >>
+         (WMULT_SHIFT - VRUNTIME_SHIFT);
+}
+
+// Group vruntime for delta milliticks of runtime in group sg.
+static uint64
+calc_delta_group(uint delta, struct sched_group *sg)
+{
+  return ((uint64)delta * NICE_0_WEIGHT * sg->inv_shares) >>
+         (WMULT_SHIFT - VRUNTIME_SHIFT);
+}
+
+static int
+rt_policy(struct proc *p)
+{
+  return p->policy == SCHED_FIFO || p->policy == SCHED_RR;
+}
+
+static int
+idle_policy(struct proc *p)
+{
+  return p->policy == SCHED_IDLE;
+}
+
+// p's group_rq on rq.
+static struct group_rq *
+proc_grq(struct proc *p, struct runqueue *rq)
+{
+  return &groups[p->group].grq[rq - runqueues];
+}
+
+// Wake the CPUs halted in cpu_idle(), other than this one.
+static void
+wake_idle_cpus(void)
+{
+  struct cpu *c;
+
+  // Pairs with the barrier in cpu_idle().
+  __sync_synchronize();
+  pushcli();
+  for (c = cpus; c < &cpus[ncpu]; c++)
+    if (c->idle && c != mycpu())
+      lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+  popcli();
+}
+
+// Timer callback at the end of a throttled group's period:
+// refill its quota and let idle CPUs pick its processes again.
+static void
+unthrottle_group(void *arg)
+{
+  struct sched_group *sg = arg;
+
+  acquire(&sg->lock);
+  sg->timer_armed = 0;
+  sg->throttled = 0;
+  sg->runtime = 0;
+  sg->period_end = ticks + sg->period;
+  release(&sg->lock);
+  wake_idle_cpus();
+}
+
+// Charge delta milliticks run on this CPU to sg's quota. Once it
+// is used up, throttle sg until the period ends, and have this CPU
+// reschedule if one of sg's processes is still running here.
+static void
+account_bandwidth(struct sched_group *sg, uint delta)
+{
+  if (sg->quota == 0)
+    return;
+  acquire(&sg->lock);
+  if (!sg->throttled && (int)(ticks - sg->period_end) >= 0)
+  {
+    sg->runtime = 0;
+    sg->period_end = ticks + sg->period;
+  }
+  sg->runtime += delta;
+  if (!sg->throttled && sg->runtime >= sg->quota)
+  {
+    sg->throttled = 1;
+    if (!sg->timer_armed)
+    {
+      sg->timer_armed = 1;
+      sg->unthrottle.expires = sg->period_end;
+      add_timer(&sg->unthrottle);
+    }
+  }
+  if (sg->throttled)
+    mycpu()->need_resched = 1;
+  release(&sg->lock);
+}
+
+// Charge the running process p for the time since its
+// exec_start, measured on the TSC of the CPU it is running on.
+// Real-time time counts against that CPU's RT_RUNTIME instead
+// of vruntime; CFS time also advances the vruntime of the group
+// p was picked from and counts against that group's quota.
+// p must not be on a runqueue.
+void update_curr(struct proc *p)
+{
+  uint delta = mticks_consume(&p->exec_start);
+  struct group_rq *grq;
+
+  p->aruntime += delta;
+  if (rt_policy(p))
+    runqueues[p->cpu].rt_time += delta;
+  else
+  {
+    p->vruntime += calc_delta_fair(delta, p);
+    if ((grq = runqueues[p->cpu].curr_grq) != 0)
+    {
+      grq->vruntime += calc_delta_group(delta, grq->sg);
+      account_bandwidth(grq->sg, delta);
+    }
+  }
+}
+
+// Move vruntime v from src's timeline to dst's, keeping its
+// lag behind min_vruntime (clamped at zero).
+static uint64
+renormalize_vruntime(uint64 v, uint64 src_min, uint64 dst_min)
+{
+  if (v + dst_min < src_min)
+    return 0;
+  return v + dst_min - src_min;
+}
+
+// Queue real-time p at the tail of its priority's list,
+// or at the head if head is set.
+static void
+enqueue_rt(struct runqueue *rq, struct proc *p, int head)
+{
+  int prio = p->rt_priority;
+
+  if (head && rq->rt_head[prio])
+  {
+    p->rt_prev = 0;
+    p->rt_next = rq->rt_head[prio];
+    rq->rt_head[prio]->rt_prev = p;
+    rq->rt_head[prio] = p;
+  }
+  else
+  {
+    p->rt_next = 0;
+    p->rt_prev = rq->rt_tail[prio];
+    if (rq->rt_tail[prio])
+      rq->rt_tail[prio]->rt_next = p;
+    else
+      rq->rt_head[prio] = p;
+    rq->rt_tail[prio] = p;
+  }
+  rq->rt_bitmap[prio / 32] |= 1 << (prio % 32);
+  rq->rt_nr_running++;
+}
+
+static void
+dequeue_rt(struct runqueue *rq, struct proc *p)
+{
+  int prio = p->rt_priority;
+
+  if (p->rt_prev)
+    p->rt_prev->rt_next = p->rt_next;
+  else
+    rq->rt_head[prio] = p->rt_next;
+  if (p->rt_next)
+    p->rt_next->rt_prev = p->rt_prev;
+  else
+    rq->rt_tail[prio] = p->rt_prev;
+  if (rq->rt_head[prio] == 0)
+    rq->rt_bitmap[prio / 32] &= ~(1 << (prio % 32));
+  rq->rt_nr_running--;
+}
+
+// Queued real-time process with the highest priority, or 0.
+static struct proc *
+rt_first(struct runqueue *rq)
+{
+  int i;
+
+  for (i = NELEM(rq->rt_bitmap) - 1; i >= 0; i--)
+    if (rq->rt_bitmap[i])
+      return rq->rt_head[i * 32 + 31 - __builtin_clz(rq->rt_bitmap[i])];
+  return 0;
+}
+
+// Put grq, which has processes queued and none running,
+// into rq's tree. rq->lock must be held.
+static void
+enqueue_group(struct runqueue *rq, struct group_rq *grq)
+{
+  struct rb_node **link = &rq->root.node;
+  struct rb_node *parent = 0;
+  int leftmost = 1;
+
+  // Equal keys go right, so ties run in FIFO order.
+  while (*link)
+  {
+    parent = *link;
+    if (rb_entry(parent, struct group_rq, rb)->vruntime > grq->vruntime)
+      link = &parent->left;
+    else
+    {
+      link = &parent->right;
+      leftmost = 0;
+    }
+  }
+  rb_link_node(&grq->rb, parent, link);
+  rb_insert_color(&grq->rb, &rq->root);
+  if (leftmost)
+    rq->leftmost = &grq->rb;
+  rq->total_weight += grq->sg->shares;
+  grq->on_rq = 1;
+}
+
+static void
+dequeue_group(struct runqueue *rq, struct group_rq *grq)
+{
+  if (rq->leftmost == &grq->rb)
+    rq->leftmost = rb_next(&grq->rb);
+  rb_erase(&grq->rb, &rq->root);
+  rq->total_weight -= grq->sg->shares;
+  grq->on_rq = 0;
+}
+
+// Insert p into the vruntime tree at root, keeping *leftmost.
+static void
+insert_proc(struct rb_root *root, struct rb_node **leftmost, struct proc *p)
+{
+  struct rb_node **link = &root->node;
+  struct rb_node *parent = 0;
+  int first = 1;
+
+  // Equal keys go right, so ties run in FIFO order.
+  while (*link)
+  {
+    parent = *link;
+    if (compare_vruntime(rb_entry(parent, struct proc, rb), p))
+      link = &parent->left;
+    else
+    {
+      link = &parent->right;
+      first = 0;
+    }
+  }
+  rb_link_node(&p->rb, parent, link);
+  rb_insert_color(&p->rb, root);
+  if (first)
+    *leftmost = &p->rb;
+}
+
+static void
+erase_proc(struct rb_root *root, struct rb_node **leftmost, struct proc *p)
+{
+  if (*leftmost == &p->rb)
+    *leftmost = rb_next(&p->rb);
+  rb_erase(&p->rb, root);
+}
+
+// Floor of the vruntimes p is queued among on rq:
+// its group's on rq, or rq's SCHED_IDLE processes'.
+static uint64
+queue_min_vruntime(struct proc *p, struct runqueue *rq)
+{
+  if (idle_policy(p))
+    return rq->idle_min_vruntime;
+  return proc_grq(p, rq)->min_vruntime;
+}
+
+// Queue CFS process p on its group_rq on rq, and the group_rq
+// on rq if it was idle there, one tick of group vruntime below
+// rq's min_vruntime at most, like a waking process.
+static void
+enqueue_cfs(struct runqueue *rq, struct proc *p)
+{
+  struct group_rq *grq = proc_grq(p, rq);
+  uint64 floor;
+
+  insert_proc(&grq->root, &grq->leftmost, p);
+  grq->total_weight += p->weight;
+  grq->nr_running++;
+  if (grq->on_rq || grq->curr)
+    return;
+  floor = calc_delta_group(1000, grq->sg);
+  floor = rq->min_vruntime > floor ? rq->min_vruntime - floor : 0;
+  if (grq->vruntime < floor)
+    grq->vruntime = floor;
+  enqueue_group(rq, grq);
+}
+
+static void
+dequeue_cfs(struct runqueue *rq, struct proc *p)
+{
+  struct group_rq *grq = proc_grq(p, rq);
+
+  erase_proc(&grq->root, &grq->leftmost, p);
+  grq->total_weight -= p->weight;
+  grq->nr_running--;
+  if (grq->nr_running == 0 && grq->on_rq)
+    dequeue_group(rq, grq);
+}
+
+// Mark p RUNNABLE and insert it into rq; a real-time p goes to the
+// head of its list if head is set. rq->lock must be held.
+static void
+enqueue_proc_at(struct runqueue *rq, struct proc *p, int head)
+{
+  if (p->on_rq)
+    panic("enqueue_proc");
+  if (rt_policy(p))
+    enqueue_rt(rq, p, head);
+  else if (idle_policy(p))
+  {
+    insert_proc(&rq->idle_root, &rq->idle_leftmost, p);
+    rq->idle_weight += p->weight;
+  }
+  else
+    enqueue_cfs(rq, p);
+  rq->nr_running++;
+  p->wait_start = rdtsc();
+  p->cpu = rq - runqueues;
+  p->on_rq = 1;
+  p->state = RUNNABLE;
+}
+
+static void
+enqueue_proc(struct runqueue *rq, struct proc *p)
+{
+  enqueue_proc_at(rq, p, 0);
+}
+
+// Take p off rq. rq->lock must be held.
+static void
+dequeue_proc(struct runqueue *rq, struct proc *p)
+{
+  if (!p->on_rq)
+    panic("dequeue_proc");
+  if (rt_policy(p))
+    dequeue_rt(rq, p);
+  else if (idle_policy(p))
+  {
+    erase_proc(&rq->idle_root, &rq->idle_leftmost, p);
+    rq->idle_weight -= p->weight;
+  }
+  else
+    dequeue_cfs(rq, p);
+  rq->nr_running--;
+  p->on_rq = 0;
+}
+
+// p is about to run: account the time it waited on the runqueue.
+static void
+sched_info_arrive(struct proc *p)
+{
+  uint delay = 0;
+  int b = 0;
+
+  // wait_start may come from another CPU's TSC.
+  if (rdtsc() > p->wait_start)
+    delay = mticks_since(p->wait_start);
+  p->wait_sum += delay;
+  p->nrun++;
+  while (delay && b < NSCHEDHIST - 1)
+  {
+    delay >>= 1;
+    b++;
+  }
+  p->delay_hist[b]++;
+}
+
+// Queued CFS process to run next: the one with the smallest
+// vruntime in the unthrottled group with the smallest group
+// vruntime, or 0.
+static struct proc *
+rq_first(struct runqueue *rq)
+{
+  struct rb_node *n;
+  struct group_rq *grq;
+
+  for (n = rq->leftmost; n; n = rb_next(n))
+  {
+    grq = rb_entry(n, struct group_rq, rb);
+    if (!grq->sg->throttled)
+      return rb_entry(grq->leftmost, struct proc, rb);
+  }
+  return 0;
+}
+
+// Has real-time work used up its share of the current period?
+static int
+rt_throttled(struct runqueue *rq)
+{
+  return rq->rt_time >= RT_RUNTIME;
+}
+
+// Queued SCHED_IDLE process with the smallest vruntime, or 0.
+static struct proc *
+idle_first(struct runqueue *rq)
+{
+  if (rq->idle_leftmost == 0)
+    return 0;
+  return rb_entry(rq->idle_leftmost, struct proc, rb);
+}
+
+// Next process to run on rq: the highest priority real-time one,
+// unless they are over RT_RUNTIME and another process is waiting;
+// then the CFS process rq_first() picks; then the SCHED_IDLE
+// process with the smallest vruntime.
+static struct proc *
+pick_next_proc(struct runqueue *rq)
+{
+  struct proc *fair;
+
+  if ((int)(ticks - rq->rt_period_end) >= 0)
+  {
+    rq->rt_time = 0;
+    rq->rt_period_end = ticks + RT_PERIOD;
+  }
+  if ((fair = rq_first(rq)) == 0)
+    fair = idle_first(rq);
+  if (rq->rt_nr_running && (!rt_throttled(rq) || fair == 0))
+    return rt_first(rq);
+  return fair;
+}
+
+// CFS process p, just taken off rq, is about to run: take its
+// group_rq off rq's tree too, so that update_curr() can advance
+// the group's vruntime, and advance the min_vruntimes.
+static void
+set_curr_group(struct runqueue *rq, struct proc *p)
+{
+  struct group_rq *grq = proc_grq(p, rq);
+
+  if (grq->on_rq)
+    dequeue_group(rq, grq);
+  grq->curr = 1;
+  rq->curr_grq = grq;
+  if (grq->min_vruntime < p->vruntime)
+    grq->min_vruntime = p->vruntime;
+  if (rq->min_vruntime < grq->vruntime)
+    rq->min_vruntime = grq->vruntime;
+}
+
+// The process picked from rq->curr_grq stopped running:
+// put the group_rq back if it has processes queued.
+static void
+put_curr_group(struct runqueue *rq)
+{
+  struct group_rq *grq = rq->curr_grq;
+
+  grq->curr = 0;
+  rq->curr_grq = 0;
+  if (grq->nr_running && !grq->on_rq)
+    enqueue_group(rq, grq);
+}
+
+// Timeslice of non-real-time p, queued on rq: its group's share
+// of SCHED_LATENCY, split among the group's processes by weight,
+// or BATCH_MIN_GRANULARITY for a SCHED_BATCH p if that is longer.
+// SCHED_IDLE processes split SCHED_LATENCY among themselves.
+static uint
+cfs_timeslice(struct runqueue *rq, struct proc *p)
+{
+  struct group_rq *grq = proc_grq(p, rq);
+  struct sched_group *sg = grq->sg;
+  uint slice;
+
+  // SCHED_IDLE끼리는 SCHED_LATENCY를 가중치 비율로
+  if (idle_policy(p))
+  {
+    slice = (SCHED_LATENCY * p->weight + rq->idle_weight / 2) / rq->idle_weight;
+    return slice < SCHED_MIN_GRANULARITY ? SCHED_MIN_GRANULARITY : slice;
+  }
+
+  // 그룹끼리 shares 비율로, 그룹 안에서는 가중치 비율로 (반올림)
+  slice = (SCHED_LATENCY * sg->shares + rq->total_weight / 2) / rq->total_weight;
+  slice = (slice * p->weight + grq->total_weight / 2) / grq->total_weight;
+  // batch는 길게 돌려서 context switch 줄이기
+  if (p->policy == SCHED_BATCH && slice < BATCH_MIN_GRANULARITY)
+    slice = BATCH_MIN_GRANULARITY;
+  // quota가 있으면 남은 만큼만
+  if (sg->quota && sg->runtime < sg->quota && slice > sg->quota - sg->runtime)
+    slice = sg->quota - sg->runtime;
+  if (slice < SCHED_MIN_GRANULARITY)
+    slice = SCHED_MIN_GRANULARITY;
+  return slice;
+}
+
+// Lock and return the runqueue of the CPU we are running on.
+static struct runqueue *
+lock_thisrq(void)
+{
+  struct runqueue *rq;
+
+  pushcli();
+  rq = &runqueues[cpuid()];
+  acquire(&rq->lock);
+  popcli();
+  return rq;
+}
+
+// Release the runqueue lock handed over by swtch().
+static void
+unlock_thisrq(void)
+{
+  release(&runqueues[cpuid()].lock);
+}
+
+// Lock and return the runqueue p belongs to. p->cpu only
+// changes under rq->lock, so check it again once locked.
+static struct runqueue *
+lock_proc_rq(struct proc *p)
+{
+  struct runqueue *rq;
+
+  for (;;)
+  {
+    rq = &runqueues[p->cpu];
+    acquire(&rq->lock);
+    if (rq == &runqueues[p->cpu])
+      return rq;
+    release(&rq->lock);
+  }
+}
+
+// Lock two runqueues in a fixed order to avoid deadlock.
+static void
+double_rq_lock(struct runqueue *a, struct runqueue *b)
+{
+  if (a < b)
+  {
+    acquire(&a->lock);
+    acquire(&b->lock);
+  }
+  else
+  {
+    acquire(&b->lock);
+    acquire(&a->lock);
+  }
+}
+
+static void
+double_rq_unlock(struct runqueue *a, struct runqueue *b)
+{
+  release(&a->lock);
+  release(&b->lock);
+}
+
+static int
+cpu_allowed(struct proc *p, int cpu)
+{
+  return (p->cpus_allowed >> cpu) & 1;
+}
+
+// Did p run recently enough that its cache is likely
+// still warm on p->cpu?
+static int
+cache_hot(struct proc *p)
+{
+  // exec_start may come from another CPU's TSC.
+  if (rdtsc() <= p->exec_start)
+    return 1;
+  return mticks_since(p->exec_start) < MIGRATION_COST;
+}
+
+// Move queued process p from src to dst, carrying its lag
+// behind queue_min_vruntime() on src over to dst.
+// Both locks must be held.
+static void
+migrate_proc(struct proc *p, struct runqueue *src, struct runqueue *dst)
+{
+  uint64 wait_start = p->wait_start;
+
+  p->nr_migrations++;
+  dequeue_proc(src, p);
+  p->vruntime = renormalize_vruntime(p->vruntime, queue_min_vruntime(p, src),
+                                     queue_min_vruntime(p, dst));
+  enqueue_proc(dst, p);
+  p->wait_start = wait_start; // still waiting since then
+}
+
+static struct waitqueue *
+waitq(void *chan)
+{
+  // Multiplicative hash; the top bits mix in all of the address.
+  return &waitqs[((uint)chan * 0x9E3779B1) >> (32 - WAITQ_SHIFT)];
+}
+
+// Append p to its wait queue wq, that for p->chan.
+// wq->lock and p->lock must be held.
+static void
+waitq_add(struct waitqueue *wq, struct proc *p)
+{
+  p->wqnext = 0;
+  p->wqprev = wq->tail;
+  if (wq->tail)
+    wq->tail->wqnext = p;
+  else
+    wq->head = p;
+  wq->tail = p;
+}
+
+// Take sleeping p off its wait queue wq and put it on a runqueue,
+// preferably that of the CPU it last ran on (select_rq()).
+// wq->lock and p->lock must be held.
+static void
+waitq_wake(struct waitqueue *wq, struct proc *p)
+{
+  struct runqueue *rq, *src;
+  uint64 min_vruntime, tick_vruntime;
+
+  if (p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    wq->head = p->wqnext;
+  if (p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  else
+    wq->tail = p->wqprev;
+  p->wqnext = p->wqprev = 0;
+  p->chan = 0;
+
+  // Its old CPU holds the lock until p is switched out.
+  src = lock_proc_rq(p);
+  rq = select_rq(p);
+  if (rq != src)
+  {
+    release(&src->lock);
+    double_rq_lock(src, rq);
+    p->cpu = rq - runqueues;
+    p->nr_migrations++;
+    release(&src->lock);
+  }
+  // 그 CPU에서 같이 줄 서는 애들 min vruntime보다 1 tick 만큼 작게 (0 아래로는 X)
+  min_vruntime = queue_min_vruntime(p, rq);
+  tick_vruntime = calc_delta_fair(1000, p);
+  if (min_vruntime > tick_vruntime)
+    p->vruntime = min_vruntime - tick_vruntime;
+  else
+    p->vruntime = 0;
+  enqueue_proc(rq, p);
+  check_preempt_wakeup(rq, p);
+  release(&rq->lock);
+  kick_idle(rq);
+}
+
+// Runqueue other than rq with the most queued processes, or 0 if
+// none has more than min. Lock-free read, so only a hint.
+static struct runqueue *
+find_busiest(struct runqueue *rq, int min)
+{
+  struct runqueue *r, *busiest = 0;
+  int max = min;
+
+  for (r = runqueues; r < &runqueues[ncpu]; r++)
+  {
+    if (r != rq && r->nr_running > max)
+    {
+      max = r->nr_running;
+      busiest = r;
+    }
+  }
+  return busiest;
+}
+
+// Least loaded runqueue p may run on. Lock-free read, so only a hint.
+static struct runqueue *
+find_idlest(struct proc *p)
+{
+  struct runqueue *r, *idlest = 0;
+
+  for (r = runqueues; r < &runqueues[ncpu]; r++)
+    if (cpu_allowed(p, r - runqueues) &&
+        (idlest == 0 || r->nr_running < idlest->nr_running))
+      idlest = r;
+  return idlest;
+}
+
+// Runqueue to wake p on: the CPU it last ran on unless that is
+// busier than another CPU p may use, by more than one process
+// while p's cache there is warm.
+static struct runqueue *
+select_rq(struct proc *p)
+{
+  struct runqueue *last = &runqueues[p->cpu];
+  struct runqueue *idlest = find_idlest(p);
+
+  if (cpu_allowed(p, p->cpu) &&
+      (last->nr_running <= idlest->nr_running ||
+       (cache_hot(p) && last->nr_running <= idlest->nr_running + 1)))
+    return last;
+  return idlest;
+}
+
+// First CFS, then SCHED_IDLE, process queued on src that may move
+// to dst: its group is not throttled, dst is in its affinity and,
+// unless idle, its cache is cold.
+static struct proc *
+pick_migratable(struct runqueue *src, struct runqueue *dst, int idle)
+{
+  struct sched_group *sg;
+  struct rb_node *n;
+  struct proc *p;
+
+  for (sg = groups; sg < &groups[NSCHEDGROUP]; sg++)
+  {
+    if (sg->throttled)
+      continue;
+    for (n = sg->grq[src - runqueues].leftmost; n; n = rb_next(n))
+    {
+      p = rb_entry(n, struct proc, rb);
+      if (cpu_allowed(p, dst - runqueues) && (idle || !cache_hot(p)))
+        return p;
+    }
+  }
+  for (n = src->idle_leftmost; n; n = rb_next(n))
+  {
+    p = rb_entry(n, struct proc, rb);
+    if (cpu_allowed(p, dst - runqueues) && (idle || !cache_hot(p)))
+      return p;
+  }
+  return 0;
+}
+
+// If p is queued on a CPU its affinity no longer allows,
+// move it to one it does. No runqueue lock may be held.
+static void
+move_disallowed(struct proc *p)
+{
+  struct runqueue *src, *dst;
+
+  for (;;)
+  {
+    src = &runqueues[p->cpu];
+    if (cpu_allowed(p, p->cpu))
+      return;
+    dst = find_idlest(p);
+    double_rq_lock(src, dst);
+    if (src == &runqueues[p->cpu])
+      break;
+    double_rq_unlock(src, dst);
+  }
+  if (p->on_rq && !cpu_allowed(p, p->cpu))
+  {
+    migrate_proc(p, src, dst);
+    check_preempt_wakeup(dst, p);
+  }
+  double_rq_unlock(src, dst);
+  kick_idle(dst);
+}
+
+// This CPU has nothing to run: steal one queued process
+// from the busiest CPU. An idle CPU beats a warm cache.
+static void
+idle_balance(struct runqueue *rq)
+{
+  struct runqueue *busiest;
+  struct proc *p;
+
+  if ((busiest = find_busiest(rq, 0)) == 0)
+    return;
+  double_rq_lock(rq, busiest);
+  if ((p = pick_migratable(busiest, rq, 1)) != 0)
+    migrate_proc(p, busiest, rq);
+  double_rq_unlock(rq, busiest);
+}
+
+// Periodic balancing, called from the timer interrupt on every CPU.
+// Pulls processes from the busiest CPU until the queues are even,
+// leaving cache-hot ones where they are.
+void load_balance(void)
+{
+  struct runqueue *rq = &runqueues[cpuid()];
+  struct runqueue *busiest;
+  struct proc *p;
+  int n;
+
+  if (ticks < rq->next_balance)
+    return;
+  rq->next_balance = ticks + BALANCE_INTERVAL;
+
+  if ((busiest = find_busiest(rq, rq->nr_running + 1)) == 0)
+    return;
+  double_rq_lock(rq, busiest);
+  n = (busiest->nr_running - rq->nr_running) / 2;
+  while (n-- > 0 && (p = pick_migratable(busiest, rq, 0)) != 0)
+    migrate_proc(p, busiest, rq);
+  double_rq_unlock(rq, busiest);
+}
+
+// p was just queued on rq; rq->lock must be held. If p should run
+// before the process rq's CPU is running (a real-time p over any
+// other or lower priority; a SCHED_NORMAL p over SCHED_IDLE, or over
+// CFS if its vruntime, or its group's if the groups differ, is lower
+// by more than WAKEUP_GRANULARITY), have that CPU reschedule on its
+// way out of trap(), interrupting it if it is not this CPU.
+// SCHED_BATCH and SCHED_IDLE processes never preempt.
+static void
+check_preempt_wakeup(struct runqueue *rq, struct proc *p)
+{
+  struct cpu *c = &cpus[rq - runqueues];
+  struct proc *curr = c->proc;
+  struct group_rq *grq;
+
+  if (curr == 0 || c->need_resched)
+    return;
+  // A remote CPU's curr is only as current as its last update.
+  if (c == mycpu())
+    update_curr(curr);
+  if (rt_policy(p))
+  {
+    // 실시간은 CFS나 더 낮은 우선순위 실시간을 바로 선점
+    if (rt_policy(curr) && curr->rt_priority >= p->rt_priority)
+      return;
+  }
+  else if (rt_policy(curr))
+  {
+    // CFS는 실시간이 RT_RUNTIME 넘게 썼을 때만 선점
+    if (!rt_throttled(rq))
+      return;
+  }
+  else if (idle_policy(p) || p->policy == SCHED_BATCH)
+    return; // idle, batch는 깨어나도 선점하지 않음
+  else if (groups[p->group].throttled)
+    return;
+  else if (idle_policy(curr))
+    ; // idle class는 CFS 프로세스가 오면 바로 양보
+  else if (rq->curr_grq && proc_grq(p, rq) != rq->curr_grq)
+  {
+    // 다른 그룹이면 그룹 vruntime끼리 비교
+    grq = proc_grq(p, rq);
+    if (grq->vruntime + calc_delta_group(WAKEUP_GRANULARITY, grq->sg) >=
+        rq->curr_grq->vruntime)
+      return;
+  }
+  else if (p->vruntime + calc_delta_fair(WAKEUP_GRANULARITY, p) >= curr->vruntime)
+    return;
+  c->need_resched = 1;
+  if (c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+}
+
+// A process was just queued on rq. If rq's CPU is idle, wake it;
+// otherwise wake some idle CPU so idle_balance() can steal it.
+static void
+kick_idle(struct runqueue *rq)
+{
+  struct cpu *c = &cpus[rq - runqueues];
+
+  // Pairs with the barrier in cpu_idle(): either we see the
+  // idle flag, or that CPU sees what we queued before halting.
+  __sync_synchronize();
+  if (!c->idle)
+  {
+    for (c = cpus; c < &cpus[ncpu]; c++)
+      if (c->idle)
+        break;
+    if (c == &cpus[ncpu])
+      return;
+  }
+  pushcli();
+  if (c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+  popcli();
+}
+
+// Nothing to run on this CPU: halt until an interrupt, unless
+// something runnable was queued on rq in the meantime. Processes
+// of throttled groups don't count; unthrottle_group() wakes us.
+static void
+cpu_idle(struct cpu *c, struct runqueue *rq)
+{
+  int busy;
+
+  cli();
+  c->idle = 1;
+  __sync_synchronize();
+  acquire(&rq->lock);
+  busy = rq->rt_nr_running || rq_first(rq) || rq->idle_leftmost;
+  release(&rq->lock);
+  if (!busy)
+  {
+    c->idle_start = rdtsc();
+    stihlt();
+    cli();
+    c->idle_mticks += mticks_consume(&c->idle_start);
+    c->idle_ticks += c->idle_mticks / 1000;
+    c->idle_mticks %= 1000;
+  }
+  c->idle = 0;
+  sti();
+}
+
+// Ticks CPU cpu has spent idle, or -1 if there is no such CPU.
+// A CPU's count catches up when it wakes from hlt.
+int idletime(int cpu)
+{
+  if (cpu < 0 || cpu >= ncpu)
+    return -1;
+  return cpus[cpu].idle_ticks;
+}
+
+// Queue a new process on the least loaded CPU, keeping the
+// vruntime it inherited from parent relative to that CPU's floor.
+static void
+wake_up_new_proc(struct proc *np, struct proc *parent)
+{
+  struct runqueue *rq = find_idlest(np);
+  struct runqueue *src;
+
+  if (parent == 0 || (src = &runqueues[parent->cpu]) == rq)
+    acquire(&rq->lock);
+  else
+  {
+    double_rq_lock(rq, src);
+    np->vruntime = renormalize_vruntime(np->vruntime, queue_min_vruntime(np, src),
+                                        queue_min_vruntime(np, rq));
+    release(&src->lock);
+  }
+  enqueue_proc(rq, np);
+  check_preempt_wakeup(rq, np);
+  release(&rq->lock);
+  kick_idle(rq);
+}
 
 void pinit(void)
 {
+  struct runqueue *rq;
+  struct sched_group *sg;
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  ptable.maxproc = NPROC;
+  kmem_cache_init(&proccache, "proccache", sizeof(struct proc));
+  for (i = 0; i < NWAITQ; i++)
+    initlock(&waitqs[i].lock, "waitq");
+  for (rq = runqueues; rq < &runqueues[NCPU]; rq++)
+    initlock(&rq->lock, "runqueue");
+  for (sg = groups; sg < &groups[NSCHEDGROUP]; sg++)
+  {
+    initlock(&sg->lock, "schedgroup");
+    sg->unthrottle.func = unthrottle_group;
+    sg->unthrottle.arg = sg;
+    for (i = 0; i < NCPU; i++)
+      sg->grq[i].sg = sg;
+  }
+  groups[0].used = 1;
+  groups[0].shares = NICE_0_WEIGHT;
+  groups[0].inv_shares = inv_weights[20];
 }
 
 // Must be called with interrupts disabled
@@ -84,50 +1252,243 @@ int cpuid()
 }
 
 // Must be called with interrupts disabled to avoid the caller being
-// rescheduled between reading lapicid and running through the loop.
+// rescheduled to another CPU while it uses the result.
+// seginit() points %gs at this CPU's struct cpu.
 struct cpu *
 mycpu(void)
 {
-  int apicid, i;
+  struct cpu *c;
 
   if (readeflags() & FL_IF)
     panic("mycpu called with interrupts enabled\n");
-
-  apicid = lapicid();
-  // APIC IDs are not guaranteed to be contiguous. Maybe we should have
-  // a reverse map, or reserve a register to store &cpus[i].
-  for (i = 0; i < ncpu; ++i)
-  {
-    if (cpus[i].apicid == apicid)
-      return &cpus[i];
-  }
-  panic("unknown apicid\n");
+  asm volatile("movl %%gs:0, %0" : "=r"(c));
+  return c;
 }
 
-// Disable interrupts so that we are not rescheduled
-// while reading proc from the cpu structure
+// Read proc from the cpu structure in a single load, so
+// being rescheduled around it does no harm: any CPU we run
+// on has us as its proc.
 struct proc *
 myproc(void)
 {
-  struct cpu *c;
   struct proc *p;
-  // 1. 인터럽트 비활성화
-  pushcli();
-  // 2. CPU 정보 받기
-  c = mycpu();
-  // 3. 현재 이 CPU에서 돌고 있는 process 받아오기
-  p = c->proc;
-  // 4. 다시 인터럽트 활성화
-  popcli();
-  // 5. 현재 cpu에서 돌아가고 있는 process 반환
+
+  // %gs:4 = 이 CPU의 cpu->proc
+  asm volatile("movl %%gs:4, %0" : "=r"(p));
   return p;
 }
 
+// Mark the start and end of a change to p's identity (pid, name,
+// parent) or of freeing it, for proc_snapshot(). Writers are
+// serialized by the slot's owner: allocproc() for an UNUSED slot,
+// wait() for a ZOMBIE child, or the process itself.
+static void
+proc_write_begin(struct proc *p)
+{
+  p->seq++;
+  __sync_synchronize();
+}
+
+static void
+proc_write_end(struct proc *p)
+{
+  __sync_synchronize();
+  p->seq++;
+}
+
+// Copy p into snap without taking a lock, retrying until no
+// proc_write_begin() overlapped the copy. Returns 0 if p is UNUSED.
+static int
+proc_snapshot(struct proc *p, struct proc *snap)
+{
+  uint seq;
+
+  for (;;)
+  {
+    seq = p->seq;
+    __sync_synchronize();
+    if (seq & 1)
+      continue;
+    memmove(snap, p, sizeof(*snap));
+    __sync_synchronize();
+    if (p->seq == seq)
+      return snap->state != UNUSED;
+  }
+}
+
+static struct proc **
+pidhash(int pid)
+{
+  return &ptable.pidhash[((uint)pid * 0x9E3779B1) >> (32 - PIDHASH_SHIFT)];
+}
+
+// Add p to the pid hash. ptable.lock must be held.
+static void
+hash_pid(struct proc *p)
+{
+  struct proc **head = pidhash(p->pid);
+
+  ptable.pidseq++;
+  __sync_synchronize();
+  p->pidnext = *head;
+  *head = p;
+  __sync_synchronize();
+  ptable.pidseq++;
+}
+
+// Remove p from the pid hash. ptable.lock must be held.
+static void
+unhash_pid(struct proc *p)
+{
+  struct proc **pp;
+
+  ptable.pidseq++;
+  __sync_synchronize();
+  for (pp = pidhash(p->pid); *pp; pp = &(*pp)->pidnext)
+  {
+    if (*pp == p)
+    {
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  p->pidnext = 0;
+  __sync_synchronize();
+  ptable.pidseq++;
+}
+
+// Process with the given pid, or 0. With ptable.lock held the
+// answer is stable; without it, p may be freed and reused at any
+// time, so recheck p->pid under p->lock or in a proc_snapshot().
+static struct proc *
+find_proc(int pid)
+{
+  struct proc *p;
+  uint seq;
+  int n;
+
+  if (pid <= 0)
+    return 0;
+  for (;;)
+  {
+    seq = ptable.pidseq;
+    __sync_synchronize();
+    if (seq & 1)
+      continue;
+    // A chain may change under us; n bounds a walk that strays.
+    for (p = *pidhash(pid), n = 0; p && p->pid != pid && n < ptable.nalloc; p = p->pidnext, n++)
+      ;
+    __sync_synchronize();
+    if (ptable.pidseq == seq)
+      return p && p->pid == pid ? p : 0;
+  }
+}
+
+// Link p into parent's child list. ptable.lock must be held.
+static void
+add_child(struct proc *parent, struct proc *p)
+{
+  p->parent = parent;
+  p->sibprev = 0;
+  p->sibnext = parent->child;
+  if (parent->child)
+    parent->child->sibprev = p;
+  parent->child = p;
+}
+
+// Unlink p from its parent's child list. ptable.lock must be held.
+static void
+del_child(struct proc *p)
+{
+  if (p->sibprev)
+    p->sibprev->sibnext = p->sibnext;
+  else
+    p->parent->child = p->sibnext;
+  if (p->sibnext)
+    p->sibnext->sibprev = p->sibprev;
+  p->sibnext = p->sibprev = 0;
+}
+
+// Add a new UNUSED descriptor from proccache. ptable.lock must be
+// held. Returns 0 if out of memory.
+static int
+proc_cache_grow(void)
+{
+  struct proc *p;
+
+  if ((p = kmem_cache_alloc(&proccache)) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
+  p->freenext = ptable.free;
+  ptable.free = p;
+  p->allnext = ptable.all;
+  // Lock-free walkers of ptable.all must see p initialized.
+  __sync_synchronize();
+  ptable.all = p;
+  ptable.nalloc++;
+  return 1;
+}
+
+// Return slot p to UNUSED and to the free list.
+// ptable.lock must be held.
+static void
+freeslot(struct proc *p)
+{
+  if (p->parent)
+    del_child(p);
+  unhash_pid(p);
+  acquire(&p->lock);
+  proc_write_begin(p);
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->state = UNUSED;
+  proc_write_end(p);
+  release(&p->lock);
+  p->freenext = ptable.free;
+  ptable.free = p;
+  ptable.nproc--;
+}
+
+// Set the limit on processes to n if n > 0. Returns the old
+// limit, or -1 if more than n processes already exist.
+int setmaxproc(int n)
+{
+  int old;
+
+  acquire(&ptable.lock);
+  old = ptable.maxproc;
+  if (n > 0)
+  {
+    if (n < ptable.nproc)
+    {
+      release(&ptable.lock);
+      return -1;
+    }
+    ptable.maxproc = n;
+  }
+  release(&ptable.lock);
+  return old;
+}
+
+// Set the current process's name (exec).
+void setpname(char *name)
+{
+  struct proc *p = myproc();
+
+  proc_write_begin(p);
+  safestrcpy(p->name, name, sizeof(p->name));
+  proc_write_end(p);
+}
+
 // PAGEBREAK: 32
-//  Look in the process table for an UNUSED proc.
+//  Take an UNUSED proc from the free list, growing the
+//  cache if it is empty.
 //  If found, change state to EMBRYO and initialize
 //  state required to run in the kernel.
-//  Otherwise return 0.
+//  Otherwise (maxproc reached or out of memory) return 0.
 static struct proc *
 allocproc(void)
 {
@@ -137,26 +1498,48 @@ allocproc(void)
   // 1. ptable lock 걸기
   acquire(&ptable.lock);
   // 2. UNUSED,,비어있는 Process 슬롯
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if (p->state == UNUSED)
-      goto found;
-
-  // 3. UNUSED가 없다면?
-  release(&ptable.lock);
-  return 0;
+  if (ptable.nproc >= ptable.maxproc || (ptable.free == 0 && !proc_cache_grow()))
+  {
+    // 3. UNUSED가 없다면?
+    release(&ptable.lock);
+    return 0;
+  }
+  p = ptable.free;
+  ptable.free = p->freenext;
+  p->freenext = 0;
+  ptable.nproc++;
 
-found:
   // 1. EMBRYO -> Process 상태 초기화 중
+  acquire(&p->lock);
+  proc_write_begin(p);
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->killed = 0;
+  proc_write_end(p);
+  release(&p->lock);
+  hash_pid(p);
+  p->child = 0;
   p->nice = 20;
   // PA2
   p->weight = weights[p->nice];
-  p->vruntime_high = 0;
-  p->vruntime_low = 0;
+  p->vruntime = 0;
   p->aruntime = 0;
   p->aruntime_prev = 0;
   p->timeslice = 0;
+  p->nsleeplocks = 0;
+  p->lockslack = 0;
+  p->on_rq = 0;
+  p->cpu = 0;
+  p->policy = SCHED_NORMAL;
+  p->rt_priority = 0;
+  p->cpus_allowed = ~0;
+  p->nr_migrations = 0;
+  p->group = 0;
+  p->wait_sum = 0;
+  p->nrun = 0;
+  p->nvcsw = 0;
+  p->nivcsw = 0;
+  memset(p->delay_hist, 0, sizeof(p->delay_hist));
 
   // 2. ptable lock 풀기
   release(&ptable.lock);
@@ -164,7 +1547,9 @@ found:
   // Allocate kernel stack.
   if ((p->kstack = kalloc()) == 0)
   {
-    p->state = UNUSED;
+    acquire(&ptable.lock);
+    freeslot(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE; // Stack Pointer
@@ -218,11 +1603,7 @@ void userinit(void)
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
-
-  p->state = RUNNABLE;
-
-  release(&ptable.lock);
+  wake_up_new_proc(p, 0);
 }
 
 // Grow current process's memory by n bytes.
@@ -235,11 +1616,14 @@ int growproc(int n)
   sz = curproc->sz;
   if (n > 0)
   {
-    if ((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // 주소 공간만 잡아 두고 page는 처음 쓸 때 할당 (vm.c: lazyfault)
+    if (sz + n >= KERNBASE || sz + n < sz)
       return -1;
+    sz += n;
   }
   else if (n < 0)
   {
+    lazyrelease(curproc->pgdir, sz + n, sz);
     if ((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   }
@@ -270,20 +1654,24 @@ int fork(void)
     // 실패하면 걍 0으로 돌림
     kfree(np->kstack);
     np->kstack = 0;
-    np->state = UNUSED;
+    acquire(&ptable.lock);
+    freeslot(np);
+    release(&ptable.lock);
     return -1;
   }
   // 현재 프로세스(부모)의 정보를 상속 받는 중
   np->sz = curproc->sz;
-  np->parent = curproc;
   *np->tf = *curproc->tf;
   // PA2
-  np->vruntime_high = curproc->vruntime_high;
-  np->vruntime_low = curproc->vruntime_low;
+  np->vruntime = curproc->vruntime;
   np->aruntime = 0;
   np->aruntime_prev = 0;
   np->nice = curproc->nice;
   np->weight = curproc->weight;
+  np->policy = curproc->policy;
+  np->rt_priority = curproc->rt_priority;
+  np->cpus_allowed = curproc->cpus_allowed;
+  np->group = curproc->group;
 
   // Clear %eax so that fork returns 0 in the child. -> 자식 프로세스에게는 0을 반환
   np->tf->eax = 0;
@@ -299,14 +1687,15 @@ int fork(void)
 
   pid = np->pid;
 
-  // Ptable에 락걸기
+  // 부모의 자식 리스트에 연결 (wait, exit에서 이것만 봄)
   acquire(&ptable.lock);
-
-  // 현재 프로세스 Runnable 큐에 넣기
-  np->state = RUNNABLE;
-
+  add_child(curproc, np);
   release(&ptable.lock);
+
+  // mmap 영역 복사는 자식이 돌기 전에 (바로 exit하면 map_exit이 못 봄)
   map_fork(np);
+  // 가장 한가한 CPU의 runqueue에 넣기
+  wake_up_new_proc(np, curproc);
   // 부모 프로세스에게 자식 프로세스 pid를 반환
   return pid;
 }
@@ -324,6 +1713,9 @@ void exit(void)
   if (curproc == initproc)
     panic("init exiting");
 
+  // mmap 영역과 그 파일 reference 반납
+  map_exit(curproc);
+
   // Close all open files.
   for (fd = 0; fd < NOFILE; fd++)
   {
@@ -343,23 +1735,26 @@ void exit(void)
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup(curproc->parent);
 
   // Pass abandoned children to init.
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  while ((p = curproc->child) != 0)
   {
-    if (p->parent == curproc)
-    {
-      // 부모가 자식보다 먼저 죽어버리면 자식을 init에게 줌.
-      p->parent = initproc;
-      // 근데 그 자식이 zombie라면 initproc을 깨워야함 -> initproc가 얘를 처리하도록 어떻게 처리할까..?
-      if (p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
+    // 부모가 자식보다 먼저 죽어버리면 자식을 init에게 줌.
+    del_child(p);
+    add_child(initproc, p);
+    // 근데 그 자식이 zombie라면 initproc을 깨워야함 -> initproc가 얘를 처리하도록 어떻게 처리할까..?
+    if (p->state == ZOMBIE)
+      wakeup(initproc);
   }
 
   // Jump into the scheduler, never to return.
+  // wait() takes our runqueue lock before freeing the kernel
+  // stack, so hold it until the scheduler has switched off it.
+  update_curr(curproc);
   curproc->state = ZOMBIE;
+  lock_thisrq();
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
@@ -380,25 +1775,22 @@ int wait(void)
   acquire(&ptable.lock);
   for (;;)
   {
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    // Scan through our children looking for exited ones.
+    havekids = curproc->child != 0;
+    for (p = curproc->child; p; p = p->sibnext)
     {
-      if (p->parent != curproc)
-        continue;
-      havekids = 1;
       if (p->state == ZOMBIE)
       {
-        // Found one.
+        // Found one. Its CPU may still be switching away
+        // from it; that ends when its runqueue lock is free.
+        acquire(&runqueues[p->cpu].lock);
+        release(&runqueues[p->cpu].lock);
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
+        lazyrelease(p->pgdir, 0, p->sz);
         freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
+        freeslot(p);
         release(&ptable.lock);
         return pid;
       }
@@ -411,7 +1803,7 @@ int wait(void)
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for children to exit.  (See wakeup call in proc_exit.)
     sleep(curproc, &ptable.lock); // DOC: wait-sleep
   }
 }
@@ -423,19 +1815,7 @@ int wait(void)
   */
 int compare_vruntime(struct proc *p1, struct proc *p2)
 {
-  if (p1->vruntime_high > p2->vruntime_high)
-    return 1;
-  else if (p1->vruntime_high < p2->vruntime_high)
-    return 0;
-  else
-  {
-    if (p1->vruntime_low > p2->vruntime_low)
-      return 1;
-    else if (p1->vruntime_low < p2->vruntime_low)
-      return 0;
-  }
-
-  return 0;
+  return p1->vruntime > p2->vruntime;
 }
 // PAGEBREAK: 42
 //  Per-CPU process scheduler.
@@ -450,9 +1830,8 @@ void scheduler(void)
   // Initialization
   struct proc *p;
   struct cpu *c = mycpu();
-  struct proc *min_p;
-  struct proc *temp_p;
-  uint total_weight;
+  struct runqueue *rq = &runqueues[c - cpus];
+  uint timeslice;
   c->proc = 0;
 
   for (;;)
@@ -460,53 +1839,70 @@ void scheduler(void)
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock); // Lock the Process table
-    total_weight = 0;
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    acquire(&rq->lock); // Lock this CPU's runqueue
+    // 1. 실시간 프로세스 먼저, 없으면 vruntime이 제일 작은 process
+    p = pick_next_proc(rq);
+    if (p == 0)
     {
-      // 1. Runnable 한게 없으면 스킵
-      if (p->state != RUNNABLE)
-      {
-        continue;
-      }
-      // 2. vruntime이 제일 작은 process 찾기 + 현재 Runnable한 전체 프로세스 가중치 합 구하기.
-      min_p = p;
-      for (temp_p = ptable.proc; temp_p < &ptable.proc[NPROC]; temp_p++)
-      {
-        if (temp_p->state == RUNNABLE)
-        {
-          total_weight += temp_p->weight;
-          if (compare_vruntime(min_p, temp_p))
-          {
-            min_p = temp_p;
-          }
-        }
-      }
-      // 3. vruntime이 최소인 프로세스의 timeslice 업데이트 + total weight 초기화
-      p = min_p;
-      // 2. Runnable 한게 있어? Switch 진행시켜
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p; // Cpu의 실행 process를 이걸로
-      p->weight = weights[p->nice];
-      switchuvm(p); // CPU가 주어진 프로세스의 가상 메모리 주소 공간을 사용하도록
-      p->state = RUNNING;
-      p->timeslice = (uint)(10000 * (p->weight / total_weight) + 0.5);
-      total_weight = 0;
-      swtch(&(c->scheduler), p->context);
-      // 3. 끝났어(exit or preempted) -> 다시 스케쥴러에게 컨트롤 줘라
-      switchkvm();
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
+      // 이 CPU에 돌릴게 없으면 제일 바쁜 CPU에서 하나 가져오기
+      // 그래도 없으면 누가 깨워줄 때까지 hlt
+      release(&rq->lock);
+      idle_balance(rq);
+      cpu_idle(c, rq);
+      continue;
     }
-    release(&ptable.lock);
+    // 2. runqueue에서 빼기 전에 timeslice 계산 (가중치 합에 p 포함)
+    timeslice = rt_policy(p) ? 0 : cfs_timeslice(rq, p);
+    dequeue_proc(rq, p);
+    if (idle_policy(p))
+    {
+      if (rq->idle_min_vruntime < p->vruntime)
+        rq->idle_min_vruntime = p->vruntime;
+    }
+    else if (!rt_policy(p))
+      set_curr_group(rq, p);
+    sched_info_arrive(p);
+    // Switch to chosen process.  It is the process's job
+    // to release rq->lock and then reacquire it
+    // before jumping back to us.
+    c->proc = p; // Cpu의 실행 process를 이걸로
+    p->weight = weights[p->nice];
+    switchuvm(p); // CPU가 주어진 프로세스의 가상 메모리 주소 공간을 사용하도록
+    p->state = RUNNING;
+    if (rt_policy(p))
+    {
+      // RR은 RR_TIMESLICE, FIFO는 끝이 없지만 RT_RUNTIME 남은 만큼만
+      p->timeslice = p->policy == SCHED_RR ? RR_TIMESLICE : RT_RUNTIME;
+      if (!rt_throttled(rq) && p->timeslice > RT_RUNTIME - rq->rt_time)
+        p->timeslice = RT_RUNTIME - rq->rt_time;
+      if (p->timeslice < SCHED_MIN_GRANULARITY)
+        p->timeslice = SCHED_MIN_GRANULARITY;
+    }
+    else
+      p->timeslice = timeslice;
+    p->lockslack = 0;
+    // timeslice 끝나는 시각에 timer interrupt
+    p->aruntime_prev = p->aruntime;
+    p->exec_start = rdtsc();
+    c->need_resched = 0;
+    set_next_event(p->timeslice);
+    swtch(&(c->scheduler), p->context);
+    // 3. 끝났어(exit or preempted) -> 다시 스케쥴러에게 컨트롤 줘라
+    switchkvm();
+    set_next_event(0);
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    if (rq->curr_grq)
+      put_curr_group(rq);
+    release(&rq->lock);
+    // affinity가 바뀌어서 여기 있으면 안 되는 프로세스는 옮겨주기
+    if (p->state == RUNNABLE && !cpu_allowed(p, c - cpus))
+      move_disallowed(p);
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only this CPU's runqueue lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -519,10 +1915,12 @@ void sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if (!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if (!holding(&runqueues[cpuid()].lock))
+    panic("sched rq.lock");
   if (mycpu()->ncli != 1)
     panic("sched locks");
+  if (mycpu()->preempt_count)
+    panic("sched preempt");
   if (p->state == RUNNING)
     panic("sched running");
   if (readeflags() & FL_IF)
@@ -533,14 +1931,52 @@ void sched(void)
 }
 
 // Give up the CPU for one scheduling round. (Preempted)
+// Keep the current process on this CPU, without turning off
+// interrupts, until the matching preempt_enable(). Nests; the
+// process must not sleep in between.
+void preempt_disable(void)
+{
+  pushcli();
+  mycpu()->preempt_count++;
+  popcli();
+}
+
+// Undo preempt_disable(). If a wakeup asked this CPU to
+// reschedule meanwhile, popcli() yields right here.
+void preempt_enable(void)
+{
+  pushcli();
+  if (--mycpu()->preempt_count < 0)
+    panic("preempt_enable");
+  popcli();
+}
+
+// Has a wakeup asked this CPU to reschedule?
+int resched_pending(void)
+{
+  int r;
+
+  pushcli();
+  r = mycpu()->need_resched;
+  popcli();
+  return r;
+}
+
 void yield(void)
 {
-  acquire(&ptable.lock); // DOC: yieldlock
-  // 현재 가지고 있는 프로세스의 state을 RUNNABLE로 바꾸기(Ready)
-  myproc()->state = RUNNABLE;
+  struct runqueue *rq = lock_thisrq(); // DOC: yieldlock
+  struct proc *p = myproc();
+  // 현재 가지고 있는 프로세스의 state을 RUNNABLE로 바꾸고 runqueue에 넣기(Ready)
+  // (tree 안에서 vruntime이 바뀌면 안 되니까 넣기 전에 시간 반영)
+  update_curr(p);
+  p->nivcsw++;
+  // 선점당한 실시간은 리스트 맨 앞으로, timeslice 다 쓴 RR만 맨 뒤로
+  enqueue_proc_at(rq, p, p->policy == SCHED_FIFO || mycpu()->need_resched);
+  // 쉬고 있는 CPU가 있으면 가져가도록 깨우기
+  kick_idle(rq);
   // 스케줄러 컨텍스트로 변경
   sched();
-  release(&ptable.lock);
+  unlock_thisrq();
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -548,8 +1984,8 @@ void yield(void)
 void forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding this CPU's runqueue lock from scheduler.
+  unlock_thisrq();
 
   if (first)
   {
@@ -569,6 +2005,7 @@ void forkret(void)
 void sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitqueue *wq = waitq(chan);
 
   if (p == 0)
     panic("sleep");
@@ -576,121 +2013,170 @@ void sleep(void *chan, struct spinlock *lk)
   if (lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
+  // Must acquire chan's wait queue lock in order to
   // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
+  // Once we hold it, we can be guaranteed that we
+  // won't miss any wakeup (wakeup runs with it locked),
   // so it's okay to release lk.
-  if (lk != &ptable.lock)
+  if (lk != &wq->lock)
   {                        // DOC: sleeplock0
-    acquire(&ptable.lock); // DOC: sleeplock1
+    acquire(&wq->lock);    // DOC: sleeplock1
     release(lk);
   }
   // Go to sleep.
+  update_curr(p);
+  acquire(&p->lock);
   p->chan = chan;
   p->state = SLEEPING;
+  p->nvcsw++;
+  waitq_add(wq, p);
+  release(&p->lock);
+
+  // Switch holding this CPU's runqueue lock instead.
+  // waitq_wake() takes it before queueing p, so p cannot run
+  // again until the scheduler has switched off it.
+  lock_thisrq();
+  release(&wq->lock);
 
   sched();
 
-  // Tidy up.
-  p->chan = 0;
+  // Tidy up. (waitq_wake already cleared p->chan)
+  unlock_thisrq();
 
   // Reacquire original lock.
-  if (lk != &ptable.lock)
-  { // DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  acquire(lk); // DOC: sleeplock2
 }
 
-// PAGEBREAK!
-//  Wake up all processes sleeping on chan.
-//  The ptable lock must be held.
-static void
-wakeup1(void *chan)
+struct sleep_timer
 {
+  struct timer timer;
   struct proc *p;
-  // PA2
-  uint min_vruntime_low;
-  uint min_vruntime_high;
-  int flag = 0;
-  // Vruntime 제일 값 찾기
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  void *chan;
+};
+
+// Timer function for sleep_timeout(): wake p if it is still asleep.
+static void
+sleep_expired(void *arg)
+{
+  struct sleep_timer *st = arg;
+  struct waitqueue *wq = waitq(st->chan);
+  struct proc *p = st->p;
+
+  acquire(&wq->lock);
+  acquire(&p->lock);
+  if (p->state == SLEEPING && p->chan == st->chan)
+    waitq_wake(wq, p);
+  release(&p->lock);
+  release(&wq->lock);
+}
+
+// Like sleep(), but also wake up after n ticks. Returns 0 if
+// the timeout expired, 1 if woken (or killed) before that.
+int sleep_timeout(void *chan, struct spinlock *lk, uint n)
+{
+  struct waitqueue *wq = waitq(chan);
+  struct sleep_timer st;
+  int pending;
+
+  if (lk != &wq->lock)
   {
-    if (p->state != RUNNABLE)
-      continue;
-    if (flag == 0)
-    {
-      min_vruntime_high = p->vruntime_high;
-      min_vruntime_low = p->vruntime_low;
-      flag = 1;
-    }
-    if (min_vruntime_high > p->vruntime_high)
-    {
-      min_vruntime_high = p->vruntime_high;
-      min_vruntime_low = p->vruntime_low;
-    }
-    else if (min_vruntime_high == p->vruntime_high && min_vruntime_low > p->vruntime_low)
-    {
-      min_vruntime_low = p->vruntime_low;
-    }
+    acquire(&wq->lock);
+    release(lk);
   }
+  // Armed under chan's wait queue lock, so it cannot fire before we sleep.
+  st.p = myproc();
+  st.chan = chan;
+  st.timer.expires = ticks + n;
+  st.timer.func = sleep_expired;
+  st.timer.arg = &st;
+  add_timer(&st.timer);
+  sleep(chan, &wq->lock);
+  // del_timer() may wait for sleep_expired(), which takes wq->lock.
+  release(&wq->lock);
+  pending = del_timer(&st.timer);
+  acquire(lk);
+  return pending;
+}
+
+// PAGEBREAK!
+// Wake up all processes sleeping on chan.
+void wakeup(void *chan)
+{
+  struct waitqueue *wq = waitq(chan);
+  struct proc *p, *next;
+
   // chan 안에서 Sleeping 중이던거 꺠우는
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  acquire(&wq->lock);
+  for (p = wq->head; p; p = next)
   {
-    if (p->state == SLEEPING && p->chan == chan)
+    next = p->wqnext;
+    if (p->chan == chan)
     {
-      p->state = RUNNABLE;
-      p->vruntime_high = flag ? min_vruntime_high : 0;
-      p->vruntime_low = flag ? (min_vruntime_low - (uint)(1024000 / p->weight)) : 0;
-      if (p->vruntime_low < 0)
-      {
-        if (p->vruntime_high > 0)
-        {
-          p->vruntime_high--;
-          p->vruntime_low += 1000000000;
-        }
-        else
-        {
-          p->vruntime_low = 0;
-        }
-      }
+      acquire(&p->lock);
+      waitq_wake(wq, p);
+      release(&p->lock);
     }
   }
+  release(&wq->lock);
 }
 
-// Wake up all processes sleeping on chan.
-void wakeup(void *chan)
+// Wake up only the longest sleeper on chan. For channels
+// where any one waiter can use what the caller freed and
+// waking the rest would just send them back to sleep.
+void wakeup_one(void *chan)
 {
-  // 락 걸고 해야해~
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  struct waitqueue *wq = waitq(chan);
+  struct proc *p;
+
+  acquire(&wq->lock);
+  for (p = wq->head; p; p = p->wqnext)
+  {
+    if (p->chan == chan)
+    {
+      acquire(&p->lock);
+      waitq_wake(wq, p);
+      release(&p->lock);
+      break;
+    }
+  }
+  release(&wq->lock);
 }
 
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
+// Takes only the locks of the process and of its wait queue.
 int kill(int pid)
 {
   struct proc *p;
+  struct waitqueue *wq;
+  void *chan;
 
-  acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  if ((p = find_proc(pid)) == 0)
+    return -1;
+  acquire(&p->lock);
+  if (p->pid != pid)
   {
-    if (p->pid == pid)
-    {
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if (p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+    // Freed or reused since we looked.
+    release(&p->lock);
+    return -1;
   }
-  release(&ptable.lock);
-  return -1;
+  p->killed = 1;
+  // Wake process from sleep if necessary. Its queue's lock
+  // comes before p->lock, so look up chan first and recheck.
+  while (p->pid == pid && p->state == SLEEPING)
+  {
+    chan = p->chan;
+    wq = waitq(chan);
+    release(&p->lock);
+    acquire(&wq->lock);
+    acquire(&p->lock);
+    if (p->state == SLEEPING && p->chan == chan)
+      waitq_wake(wq, p);
+    release(&wq->lock);
+  }
+  release(&p->lock);
+  return 0;
 }
 
 // PAGEBREAK: 36
@@ -711,7 +2197,7 @@ void procdump(void)
   char *state;
   uint pc[10];
 
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  for (p = ptable.all; p; p = p->allnext)
   {
     if (p->state == UNUSED)
       continue;
@@ -728,67 +2214,244 @@ void procdump(void)
     }
     cprintf("\n");
   }
+  latencydump();
 }
 
 int getpname(int pid)
 {
   struct proc *p;
+  struct proc snap;
+
+  if ((p = find_proc(pid)) == 0 || !proc_snapshot(p, &snap) || snap.pid != pid)
+    return -1;
+  cprintf("%s\n", snap.name);
+  return 0;
+}
+
+int getnice(int pid)
+{
+  if (pid <= 0)
+    return -1;
+  struct proc *p;
+  struct proc snap;
+  if ((p = find_proc(pid)) == 0 || !proc_snapshot(p, &snap) || snap.pid != pid)
+    return -1;
+  return snap.nice;
+}
+
+int setnice(int pid, int value)
+{
+  if (value < 0 || value > 39 || pid <= 0)
+  {
+    return -1;
+  }
 
+  struct proc *p;
+  struct runqueue *rq;
   acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  if ((p = find_proc(pid)) == 0)
   {
-    if (p->pid == pid)
-    {
-      cprintf("%s\n", p->name);
-      release(&ptable.lock);
-      return 0;
-    }
+    release(&ptable.lock);
+    return -1;
   }
+  p->nice = value;
+  // PA2: runqueue에 있다면 가중치 합도 갱신
+  rq = lock_proc_rq(p);
+  if (p->on_rq && idle_policy(p))
+    rq->idle_weight += weights[value] - p->weight;
+  else if (p->on_rq && !rt_policy(p))
+    proc_grq(p, rq)->total_weight += weights[value] - p->weight;
+  p->weight = weights[value];
+  release(&rq->lock);
   release(&ptable.lock);
-  return -1;
+  return 0;
 }
 
-int getnice(int pid)
+// Move process pid to scheduling class policy: SCHED_NORMAL,
+// SCHED_BATCH or SCHED_IDLE with prio 0, or SCHED_FIFO/SCHED_RR
+// with prio 1..MAX_RT_PRIO.
+int sched_setscheduler(int pid, int policy, int prio)
 {
+  struct proc *p;
+  struct runqueue *rq;
+  struct cpu *c;
+  int queued, old;
+
   if (pid <= 0)
     return -1;
-  struct proc *p;
+  if (policy == SCHED_FIFO || policy == SCHED_RR)
+  {
+    if (prio < 1 || prio > MAX_RT_PRIO)
+      return -1;
+  }
+  else if ((policy != SCHED_NORMAL && policy != SCHED_BATCH && policy != SCHED_IDLE) ||
+           prio != 0)
+    return -1;
+
   acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  if ((p = find_proc(pid)) == 0 || p->state == ZOMBIE)
   {
-    if (p->pid == pid)
-    {
-      int result = p->nice;
-      release(&ptable.lock);
-      return result;
-    }
+    release(&ptable.lock);
+    return -1;
+  }
+  rq = lock_proc_rq(p);
+  if (p == myproc())
+    update_curr(p); // 예전 class로 정산
+  queued = p->on_rq;
+  if (queued)
+    dequeue_proc(rq, p);
+  old = p->policy;
+  p->policy = policy;
+  p->rt_priority = prio;
+  // 다른 줄로 옮기면 거기 min vruntime부터 (NORMAL, BATCH는 같은 줄)
+  if (!rt_policy(p) && (old == SCHED_FIFO || old == SCHED_RR ||
+                        (old == SCHED_IDLE) != idle_policy(p)))
+    p->vruntime = queue_min_vruntime(p, rq);
+  if (queued)
+  {
+    enqueue_proc(rq, p);
+    check_preempt_wakeup(rq, p);
+  }
+  else if (p->state == RUNNING)
+  {
+    // 돌고 있으면 다시 골라보기
+    c = &cpus[p->cpu];
+    c->need_resched = 1;
+    if (c != mycpu())
+      lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
   }
+  release(&rq->lock);
   release(&ptable.lock);
-  return -1;
+  return 0;
 }
 
-int setnice(int pid, int value)
+// Restrict process pid to the CPUs in mask (bit n = CPU n).
+// A RUNNING pid is told to reschedule, and queued or running
+// it is moved to a CPU mask allows.
+int sched_setaffinity(int pid, uint mask)
 {
-  if (value < 0 || value > 39 || pid <= 0)
+  struct proc *p;
+  struct runqueue *rq;
+  struct cpu *c;
+
+  mask &= (1 << ncpu) - 1;
+  if (pid <= 0 || mask == 0)
+    return -1;
+
+  acquire(&ptable.lock);
+  if ((p = find_proc(pid)) == 0 || p->state == ZOMBIE)
+  {
+    release(&ptable.lock);
+    return -1;
+  }
+  rq = lock_proc_rq(p);
+  p->cpus_allowed = mask;
+  if (p->state == RUNNING && !cpu_allowed(p, p->cpu))
   {
+    c = &cpus[p->cpu];
+    c->need_resched = 1;
+    if (c != mycpu())
+      lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+  }
+  release(&rq->lock);
+  move_disallowed(p);
+  release(&ptable.lock);
+  return 0;
+}
+
+// CPU mask process pid may run on, or -1.
+int sched_getaffinity(int pid)
+{
+  struct proc *p;
+  struct proc snap;
+
+  if ((p = find_proc(pid)) == 0 || !proc_snapshot(p, &snap) || snap.pid != pid)
     return -1;
+  return snap.cpus_allowed & ((1 << ncpu) - 1);
+}
+
+// Set up CPU bandwidth group group (1..NSCHEDGROUP-1): its shares
+// against the other groups, in the range of the nice weights, and
+// a quota of quota ticks of CPU time every period ticks, summed
+// over all CPUs (quota 0 for no limit). period is at most
+// GROUP_MAX_PERIOD, so neither quota check nor milliticks overflow.
+int sched_groupctl(int group, int shares, int quota, int period)
+{
+  struct sched_group *sg;
+  struct runqueue *rq;
+  struct group_rq *grq;
+
+  if (group <= 0 || group >= NSCHEDGROUP)
+    return -1;
+  if (shares < weights[39] || shares > weights[0])
+    return -1;
+  if (quota < 0 || (quota && (period <= 0 || period > GROUP_MAX_PERIOD ||
+                              quota > period * ncpu)))
+    return -1;
+  sg = &groups[group];
+
+  // shares는 모든 CPU의 total_weight에 들어가 있으니 전부 잠그고 바꾸기
+  for (rq = runqueues; rq < &runqueues[ncpu]; rq++)
+    acquire(&rq->lock);
+  for (rq = runqueues; rq < &runqueues[ncpu]; rq++)
+  {
+    grq = &sg->grq[rq - runqueues];
+    if (grq->on_rq)
+      rq->total_weight += shares - sg->shares;
   }
+  sg->shares = shares;
+  sg->inv_shares = 0xFFFFFFFF / shares + 1;
+  acquire(&sg->lock);
+  sg->quota = quota * 1000;
+  sg->period = period;
+  sg->runtime = 0;
+  sg->period_end = ticks + period;
+  sg->throttled = 0;
+  release(&sg->lock);
+  sg->used = 1;
+  for (rq = runqueues; rq < &runqueues[ncpu]; rq++)
+    release(&rq->lock);
+  wake_idle_cpus();
+  return 0;
+}
 
+// Move process pid into CPU bandwidth group group, keeping its
+// lag behind the group's min_vruntime. Its children inherit it.
+int sched_setgroup(int pid, int group)
+{
   struct proc *p;
+  struct runqueue *rq;
+  uint64 wait_start;
+  int queued;
+
+  if (pid <= 0 || group < 0 || group >= NSCHEDGROUP || !groups[group].used)
+    return -1;
+
   acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  if ((p = find_proc(pid)) == 0 || p->state == ZOMBIE)
   {
-    if (p->pid == pid)
-    {
-      p->nice = value;
-      // PA2
-      p->weight = weights[value];
-      release(&ptable.lock);
-      return 0;
-    }
+    release(&ptable.lock);
+    return -1;
   }
+  // 돌고 있으면 update_curr()는 멈출 때까지 원래 그룹(curr_grq)에 반영
+  rq = lock_proc_rq(p);
+  wait_start = p->wait_start;
+  queued = p->on_rq;
+  if (queued)
+    dequeue_proc(rq, p);
+  if (!rt_policy(p) && !idle_policy(p))
+    p->vruntime = renormalize_vruntime(p->vruntime, proc_grq(p, rq)->min_vruntime,
+                                       groups[group].grq[rq - runqueues].min_vruntime);
+  p->group = group;
+  if (queued)
+  {
+    enqueue_proc(rq, p);
+    p->wait_start = wait_start;
+    check_preempt_wakeup(rq, p);
+  }
+  release(&rq->lock);
   release(&ptable.lock);
-  return -1;
+  return 0;
 }
 int get_digit_count(int num)
 {
@@ -800,81 +2463,106 @@ int get_digit_count(int num)
   }
   return count;
 }
-void ps(int pid)
+
+// v / d for a 64-bit v, remainder in *rem. Shift and subtract,
+// since the kernel is not linked with libgcc's 64-bit divide.
+static uint64
+divmod64(uint64 v, uint d, uint *rem)
 {
-  if (pid < 0)
-    return;
-  struct proc *p;
-  struct proc *temp[NPROC];
-  int count = 0;
-  const char *stateNames[] = {"UNUSED", "EMBRYO", "SLEEPING", "RUNNABLE", "RUNNING", "ZOMBIE"};
-  acquire(&ptable.lock);
-  // PA2
-  if (pid)
+  uint64 q = 0, r = 0;
+  int i;
+
+  for (i = 63; i >= 0; i--)
   {
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    r = (r << 1) | ((v >> i) & 1);
+    if (r >= d)
     {
-      if (p->pid == pid && p->state != UNUSED)
-      {
-        cprintf("%20s%20s%20s%20s%20s%20s%20s%5s%d", "name", "pid", "state", "priority", "runtime/weight", "runtime", "vruntime", "tick", ticks); // Space 12
-        cprintf("000\n");
-        cprintf("%20s%20d%20s%20d%20d%20d", p->name, p->pid, stateNames[p->state], p->nice, p->aruntime / p->weight, p->aruntime);
-        if (p->vruntime_high)
-        {
-          int zero_count = 9 - get_digit_count(p->vruntime_low); // 9에서 vruntime_low의 자릿수를 뺀 만큼
-          cprintf("%d", p->vruntime_high);                       // vruntime_high 출력
-          while (zero_count--)                                   // 필요한 만큼의 0들 출력
-          {
-            cprintf("0");
-          }
-          cprintf("%d\n", p->vruntime_low); // vruntime_low 출력
-        }
-        else
-        {
-          cprintf("%20d\n", p->vruntime_low);
-        }
-
-        release(&ptable.lock);
-        return;
-      }
+      r -= d;
+      q |= 1ULL << i;
     }
   }
-  else
+  *rem = r;
+  return q;
+}
+
+// Print p's vruntime in whole milliticks, right-aligned in 20 columns.
+static void
+print_vruntime(struct proc *p)
+{
+  uint high, low;
+
+  high = divmod64(p->vruntime >> VRUNTIME_SHIFT, 1000000000, &low);
+  if (high)
   {
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    int zero_count = 9 - (low ? get_digit_count(low) : 1); // 9에서 low의 자릿수를 뺀 만큼
+    cprintf("%d", high);                                    // high 출력
+    while (zero_count--)                                    // 필요한 만큼의 0들 출력
     {
-      if (p->state != UNUSED)
-      {
-        temp[count++] = p;
-      }
+      cprintf("0");
     }
-    if (count)
+    cprintf("%d\n", low); // low 출력
+  }
+  else
+  {
+    cprintf("%20d\n", low);
+  }
+}
+// Print the process with the given pid, or every process if pid is 0.
+// Each row is a proc_snapshot(), so no lock is held while printing.
+void ps(int pid)
+{
+  if (pid < 0)
+    return;
+  struct proc *p;
+  struct proc snap;
+  int header = 0;
+  const char *stateNames[] = {"UNUSED", "EMBRYO", "SLEEPING", "RUNNABLE", "RUNNING", "ZOMBIE"};
+  const char *policyNames[] = {"NORMAL", "FIFO", "RR", "BATCH", "IDLE"};
+  // PA2
+  for (p = pid ? find_proc(pid) : ptable.all; p; p = pid ? 0 : p->allnext)
+  {
+    if (!proc_snapshot(p, &snap) || (pid && snap.pid != pid))
+      continue;
+    if (!header)
     {
-      cprintf("%20s%20s%20s%20s%20s%20s%20s%5s%d", "name", "pid", "state", "priority", "runtime/weight", "runtime", "vruntime", "tick", ticks);
+      cprintf("%20s%20s%20s%10s%5s%20s%5s%8s%20s%20s%20s%5s%d", "name", "pid", "state", "class", "grp", "priority", "cpu", "migr", "runtime/weight", "runtime", "vruntime", "tick", ticks); // Space 12
       cprintf("000\n");
+      header = 1;
     }
-    for (int i = 0; i < count; i++)
-    {
-      cprintf("%20s%20d%20s%20d%20d%20d", temp[i]->name, temp[i]->pid, stateNames[temp[i]->state], temp[i]->nice, temp[i]->aruntime / temp[i]->weight, temp[i]->aruntime);
-      if (temp[i]->vruntime_high)
-      {
-        int zero_count = 9 - get_digit_count(temp[i]->vruntime_low); // 9에서 vruntime_low의 자릿수를 뺀 만큼
-        cprintf("%d", temp[i]->vruntime_high);                       // vruntime_high 출력
-        while (zero_count--)                                         // 필요한 만큼의 0들 출력
-        {
-          cprintf("0");
-        }
-        cprintf("%d\n", temp[i]->vruntime_low); // vruntime_low 출력
-      }
-      else
-      {
-        cprintf("%20d\n", temp[i]->vruntime_low);
-      }
-    }
+    // 실시간이면 priority 자리에 rt_priority
+    cprintf("%20s%20d%20s%10s%5d%20d%5d%8d%20d%20d", snap.name, snap.pid, stateNames[snap.state], policyNames[snap.policy], snap.group, rt_policy(&snap) ? snap.rt_priority : snap.nice, snap.cpu, snap.nr_migrations, snap.aruntime / snap.weight, snap.aruntime);
+    print_vruntime(&snap);
+  }
+}
 
-    release(&ptable.lock);
-    return;
+// Copy the scheduler statistics of up to n processes to
+// user address addr. Returns the number copied, or -1.
+int schedstat(uint addr, int n)
+{
+  struct proc *p;
+  struct proc snap;
+  struct schedstat st;
+  int count = 0;
+
+  for (p = ptable.all; p && count < n; p = p->allnext)
+  {
+    if (!proc_snapshot(p, &snap))
+      continue;
+    st.pid = snap.pid;
+    st.state = snap.state;
+    st.nice = snap.nice;
+    st.cpu = snap.cpu;
+    safestrcpy(st.name, snap.name, sizeof(st.name));
+    st.runtime = snap.aruntime;
+    st.vruntime = snap.vruntime >> VRUNTIME_SHIFT;
+    st.wait = snap.wait_sum;
+    st.nrun = snap.nrun;
+    st.nvcsw = snap.nvcsw;
+    st.nivcsw = snap.nivcsw;
+    memmove(st.delay, snap.delay_hist, sizeof(st.delay));
+    if (copyout(myproc()->pgdir, addr + count * sizeof(st), &st, sizeof(st)) < 0)
+      return -1;
+    count++;
   }
-  release(&ptable.lock);
-  return;
+  return count;
 }
@@ -1,6 +1,8 @@
 // Per-CPU state
 struct cpu
 {
+  struct cpu *self;          // This struct, at %gs:0 (mycpu)
+  struct proc *proc;         // The process running on this cpu or null, at %gs:4
   uchar apicid;              // Local APIC ID
   struct context *scheduler; // swtch() here to enter scheduler
   struct taskstate ts;       // Used by x86 to find stack for interrupt
@@ -8,7 +10,19 @@ struct cpu
   volatile uint started;     // Has the CPU started?
   int ncli;                  // Depth of pushcli nesting.
   int intena;                // Were interrupts enabled before pushcli?
-  struct proc *proc;         // The process running on this cpu or null
+  int preempt_count;         // preempt_disable() depth (spinlock.c: popcli)
+  volatile int need_resched; // A woken process should preempt proc
+  volatile int idle;         // Halted, or about to, in cpu_idle()
+  uint64 idle_start;         // TSC when the current idle period began
+  uint idle_ticks;           // Time spent idle, in ticks
+  uint idle_mticks;          //   plus milliticks
+#ifdef LATENCYTRACE
+  uint64 np_start;           // TSC when this CPU last became non-preemptible
+  uint np_pcs[10];           //   and the call stack there (spinlock.c)
+  uint64 np_max;             // Longest non-preemptible section so far
+  uint np_max_start[10];     //   where it began
+  uint np_max_end[10];       //   and where it ended
+#endif
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,6 +48,27 @@ struct context
   uint eip;
 };
 
+// Red-black tree node, embedded in the structure it orders (rbtree.c).
+struct rb_node
+{
+  struct rb_node *parent;
+  struct rb_node *left;
+  struct rb_node *right;
+  int color; // RB_RED or RB_BLACK
+};
+
+struct rb_root
+{
+  struct rb_node *node;
+};
+
+#define RB_RED 0
+#define RB_BLACK 1
+
+// Containing structure of an embedded rb_node.
+#define rb_entry(ptr, type, member) \
+  ((type *)((char *)(ptr) - (uint)&((type *)0)->member))
+
 enum procstate
 {
   UNUSED,
@@ -47,6 +82,8 @@ enum procstate
 // Per-process state
 struct proc
 {
+  struct spinlock lock;       // Guards pid, killed, and sleeping (state, chan)
+  uint seq;                   // Odd while pid/name change (proc.c: proc_snapshot)
   uint sz;                    // Size of process memory (bytes)
   pde_t *pgdir;               // Page table
   char *kstack;               // Bottom of kernel stack for this process
@@ -63,11 +100,38 @@ struct proc
   int nice;                   // NICE Value [default = 20, 0 <= nice value <= 39]
   // PA2
   int weight;         // nice값에 따른 가중치
-  uint vruntime_high; // high virtual runtime -> 밀리틱 단위
-  uint vruntime_low;  // low virtual runtime -> 밀리틱 단위
+  uint64 vruntime;    // virtual runtime -> 밀리틱 단위 고정소수점 (proc.c)
   uint aruntime;      // actual runtime -> 실제 전체 얼만큼 밀리틱 단위
   uint aruntime_prev; // Previous Actual Runtime -> 이번에 CPU 잡기 전에 얼만큼 썼었는지
   uint timeslice;     // current timeslice -> 밀리틱 단위,
+  uint64 exec_start;  // aruntime에 반영된 마지막 시각 (TSC)
+  // schedstat (schedstat.h)
+  uint64 wait_start;  // runqueue에 들어간 시각 (TSC)
+  uint wait_sum;      // runqueue에서 기다린 시간 합 -> 밀리틱 단위
+  uint nrun;          // CPU를 잡은 횟수
+  uint nvcsw;         // sleep으로 CPU 내놓은 횟수
+  uint nivcsw;        // 선점당한 횟수
+  uint delay_hist[NSCHEDHIST]; // 기다린 시간 log2 히스토그램
+  struct rb_node rb;  // runqueue 노드 (vruntime 순서)
+  int on_rq;          // runqueue에 들어있는지
+  int cpu;            // 속한 runqueue(CPU) 번호, 마지막으로 돈 CPU
+  int policy;         // SCHED_NORMAL, SCHED_FIFO, SCHED_RR (param.h)
+  int rt_priority;    // FIFO/RR 우선순위 1..MAX_RT_PRIO, 클수록 먼저
+  struct proc *rt_next; // FIFO/RR runqueue 리스트 링크
+  struct proc *rt_prev;
+  uint cpus_allowed;  // 돌 수 있는 CPU mask (bit n = CPU n)
+  uint nr_migrations; // 다른 CPU로 옮겨진 횟수
+  int group;          // CPU bandwidth group (proc.c), 0이면 기본 그룹
+  int nsleeplocks;    // 잡고 있는 sleeplock 수 (sleeplock.c)
+  int lockslack;      // sleeplock 때문에 timeslice를 넘겨 받았음 (trap.c)
+  struct proc *wqnext; // SLEEPING일 때 wait queue 링크
+  struct proc *wqprev;
+  struct proc *child;   // 첫 번째 자식 (ptable.lock)
+  struct proc *sibnext; // 같은 부모의 자식 리스트 링크
+  struct proc *sibprev;
+  struct proc *pidnext; // pid hash chain (proc.c: find_proc)
+  struct proc *allnext;  // 모든 PCB 리스트 링크 (proc.c: ptable)
+  struct proc *freenext; // UNUSED일 때 free list 링크
 };
 
 // Process memory is laid out contiguously, low addresses first:
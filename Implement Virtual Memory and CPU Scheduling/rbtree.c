@@ -0,0 +1,301 @@
+// Red-black tree.
+//
+// The tree is intrusive: callers embed a struct rb_node in their own
+// structure and recover it with rb_entry().  Ordering is the caller's
+// business; to insert, walk down from root->node to find the empty link
+// where the new node belongs, then call rb_link_node() and
+// rb_insert_color() to rebalance.  No memory is allocated here.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+
+static void
+rb_rotate_left(struct rb_node *x, struct rb_root *root)
+{
+  struct rb_node *y = x->right;
+
+  x->right = y->left;
+  if (y->left)
+    y->left->parent = x;
+  y->parent = x->parent;
+  if (x->parent == 0)
+    root->node = y;
+  else if (x == x->parent->left)
+    x->parent->left = y;
+  else
+    x->parent->right = y;
+  y->left = x;
+  x->parent = y;
+}
+
+static void
+rb_rotate_right(struct rb_node *x, struct rb_root *root)
+{
+  struct rb_node *y = x->left;
+
+  x->left = y->right;
+  if (y->right)
+    y->right->parent = x;
+  y->parent = x->parent;
+  if (x->parent == 0)
+    root->node = y;
+  else if (x == x->parent->right)
+    x->parent->right = y;
+  else
+    x->parent->left = y;
+  y->right = x;
+  x->parent = y;
+}
+
+static int
+rb_is_black(struct rb_node *n)
+{
+  return n == 0 || n->color == RB_BLACK;
+}
+
+// Hang node below parent at *link (a child pointer of parent,
+// or &root->node for an empty tree).  The tree is not yet balanced.
+void rb_link_node(struct rb_node *node, struct rb_node *parent,
+                  struct rb_node **link)
+{
+  node->parent = parent;
+  node->left = node->right = 0;
+  node->color = RB_RED;
+  *link = node;
+}
+
+// Restore the red-black properties after rb_link_node().
+void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+  struct rb_node *parent, *gparent, *uncle, *tmp;
+
+  while ((parent = node->parent) != 0 && parent->color == RB_RED)
+  {
+    // parent is red, so it is not the root and gparent exists.
+    gparent = parent->parent;
+    if (parent == gparent->left)
+    {
+      uncle = gparent->right;
+      if (!rb_is_black(uncle))
+      {
+        uncle->color = RB_BLACK;
+        parent->color = RB_BLACK;
+        gparent->color = RB_RED;
+        node = gparent;
+        continue;
+      }
+      if (parent->right == node)
+      {
+        rb_rotate_left(parent, root);
+        tmp = parent;
+        parent = node;
+        node = tmp;
+      }
+      parent->color = RB_BLACK;
+      gparent->color = RB_RED;
+      rb_rotate_right(gparent, root);
+    }
+    else
+    {
+      uncle = gparent->left;
+      if (!rb_is_black(uncle))
+      {
+        uncle->color = RB_BLACK;
+        parent->color = RB_BLACK;
+        gparent->color = RB_RED;
+        node = gparent;
+        continue;
+      }
+      if (parent->left == node)
+      {
+        rb_rotate_right(parent, root);
+        tmp = parent;
+        parent = node;
+        node = tmp;
+      }
+      parent->color = RB_BLACK;
+      gparent->color = RB_RED;
+      rb_rotate_left(gparent, root);
+    }
+  }
+  root->node->color = RB_BLACK;
+}
+
+// Fix up a black-height deficit at node (possibly null),
+// whose parent is parent, after a black node was removed.
+static void
+rb_erase_color(struct rb_node *node, struct rb_node *parent,
+               struct rb_root *root)
+{
+  struct rb_node *other;
+
+  while (rb_is_black(node) && node != root->node)
+  {
+    if (parent->left == node)
+    {
+      other = parent->right;
+      if (other->color == RB_RED)
+      {
+        other->color = RB_BLACK;
+        parent->color = RB_RED;
+        rb_rotate_left(parent, root);
+        other = parent->right;
+      }
+      if (rb_is_black(other->left) && rb_is_black(other->right))
+      {
+        other->color = RB_RED;
+        node = parent;
+        parent = node->parent;
+      }
+      else
+      {
+        if (rb_is_black(other->right))
+        {
+          other->left->color = RB_BLACK;
+          other->color = RB_RED;
+          rb_rotate_right(other, root);
+          other = parent->right;
+        }
+        other->color = parent->color;
+        parent->color = RB_BLACK;
+        other->right->color = RB_BLACK;
+        rb_rotate_left(parent, root);
+        node = root->node;
+        break;
+      }
+    }
+    else
+    {
+      other = parent->left;
+      if (other->color == RB_RED)
+      {
+        other->color = RB_BLACK;
+        parent->color = RB_RED;
+        rb_rotate_right(parent, root);
+        other = parent->left;
+      }
+      if (rb_is_black(other->left) && rb_is_black(other->right))
+      {
+        other->color = RB_RED;
+        node = parent;
+        parent = node->parent;
+      }
+      else
+      {
+        if (rb_is_black(other->left))
+        {
+          other->right->color = RB_BLACK;
+          other->color = RB_RED;
+          rb_rotate_left(other, root);
+          other = parent->left;
+        }
+        other->color = parent->color;
+        parent->color = RB_BLACK;
+        other->left->color = RB_BLACK;
+        rb_rotate_right(parent, root);
+        node = root->node;
+        break;
+      }
+    }
+  }
+  if (node)
+    node->color = RB_BLACK;
+}
+
+// Remove node from the tree and rebalance.
+void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+  struct rb_node *child, *parent, *old, *left;
+  int color;
+
+  if (node->left == 0)
+    child = node->right;
+  else if (node->right == 0)
+    child = node->left;
+  else
+  {
+    // Two children: splice out the in-order successor
+    // and put it in node's place.
+    old = node;
+    node = node->right;
+    while ((left = node->left) != 0)
+      node = left;
+
+    if (old->parent == 0)
+      root->node = node;
+    else if (old->parent->left == old)
+      old->parent->left = node;
+    else
+      old->parent->right = node;
+
+    child = node->right;
+    parent = node->parent;
+    color = node->color;
+
+    if (parent == old)
+      parent = node;
+    else
+    {
+      if (child)
+        child->parent = parent;
+      parent->left = child;
+      node->right = old->right;
+      old->right->parent = node;
+    }
+    node->parent = old->parent;
+    node->color = old->color;
+    node->left = old->left;
+    old->left->parent = node;
+    goto fixup;
+  }
+
+  parent = node->parent;
+  color = node->color;
+  if (child)
+    child->parent = parent;
+  if (parent == 0)
+    root->node = child;
+  else if (parent->left == node)
+    parent->left = child;
+  else
+    parent->right = child;
+
+fixup:
+  if (color == RB_BLACK)
+    rb_erase_color(child, parent, root);
+}
+
+// Smallest node in the tree, or 0 if empty.
+struct rb_node *
+rb_first(struct rb_root *root)
+{
+  struct rb_node *n = root->node;
+
+  if (n == 0)
+    return 0;
+  while (n->left)
+    n = n->left;
+  return n;
+}
+
+// In-order successor of node, or 0 if node is the largest.
+struct rb_node *
+rb_next(struct rb_node *node)
+{
+  struct rb_node *parent;
+
+  if (node->right)
+  {
+    node = node->right;
+    while (node->left)
+      node = node->left;
+    return node;
+  }
+  while ((parent = node->parent) != 0 && node == parent->right)
+    node = parent;
+  return parent;
+}
@@ -0,0 +1,78 @@
+// schedstat [ticks]
+// With no argument, print every process's scheduler statistics.
+// Given a number of ticks, take two snapshots that far apart and
+// print what each process got in between, e.g. to compare how
+// processes at different nice levels share the CPUs.
+
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "schedstat.h"
+
+struct schedstat before[NPROC], after[NPROC];
+
+// Print s, less what old already had (old may be 0).
+void
+print(struct schedstat *s, struct schedstat *old, uint total)
+{
+  struct schedstat zero;
+  int i, last;
+
+  if(old == 0){
+    memset(&zero, 0, sizeof(zero));
+    old = &zero;
+  }
+  printf(1, "%d %s nice %d cpu %d run %d", s->pid, s->name, s->nice,
+         s->cpu, s->runtime - old->runtime);
+  if(total >= 100)
+    printf(1, " (%d%%)", (s->runtime - old->runtime) / (total / 100));
+  printf(1, " vrun %d wait %d picks %d vol %d invol %d",
+         (uint)(s->vruntime - old->vruntime), s->wait - old->wait,
+         s->nrun - old->nrun, s->nvcsw - old->nvcsw, s->nivcsw - old->nivcsw);
+  for(last = NSCHEDHIST - 1; last > 0; last--)
+    if(s->delay[last] != old->delay[last])
+      break;
+  printf(1, " delay");
+  for(i = 0; i <= last; i++)
+    printf(1, " %d", s->delay[i] - old->delay[i]);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, m, i, j;
+  uint total;
+  struct schedstat *old;
+
+  if((n = schedstat(before, NPROC)) < 0){
+    printf(2, "schedstat: failed\n");
+    exit();
+  }
+  if(argc < 2){
+    for(i = 0; i < n; i++)
+      print(&before[i], 0, 0);
+    exit();
+  }
+
+  sleep(atoi(argv[1]));
+  if((m = schedstat(after, NPROC)) < 0){
+    printf(2, "schedstat: failed\n");
+    exit();
+  }
+  total = 0;
+  for(i = 0; i < m; i++){
+    total += after[i].runtime;
+    for(j = 0; j < n; j++)
+      if(before[j].pid == after[i].pid)
+        total -= before[j].runtime;
+  }
+  for(i = 0; i < m; i++){
+    old = 0;
+    for(j = 0; j < n; j++)
+      if(before[j].pid == after[i].pid)
+        old = &before[j];
+    print(&after[i], old, total);
+  }
+  exit();
+}
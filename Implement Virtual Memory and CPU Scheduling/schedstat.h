@@ -0,0 +1,20 @@
+// Per-process scheduler statistics, as copied out by schedstat().
+// Times are in milliticks (1/1000 tick). Needs param.h.
+#define NSCHEDSTAT 1024 // Most processes one schedstat() call copies
+
+struct schedstat {
+  int pid;
+  int state;              // enum procstate in proc.h
+  int nice;
+  int cpu;                // CPU it last ran on
+  char name[16];
+  uint runtime;           // Time spent running
+  uint64 vruntime;        // Virtual runtime
+  uint wait;              // Time spent queued, waiting to run
+  uint nrun;              // Times it was picked to run
+  uint nvcsw;             // Voluntary switches (went to sleep)
+  uint nivcsw;            // Involuntary switches (preempted)
+  uint delay[NSCHEDHIST]; // Picks by how long it had waited: delay[0]
+                          // under 1, delay[i] 2^(i-1) up to 2^i, and
+                          // the last bucket everything longer
+};
@@ -0,0 +1,182 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size, carved out of slabs:
+// blocks of 2^order pages from kalloc_pages() with a struct slab at
+// the start and the objects after it. The order is the smallest that
+// fits SLAB_MINOBJS objects. A slab is aligned to its own size, so
+// an object's slab is found by rounding its address down. Slabs with
+// free objects are on the cache's partial list; a slab whose objects
+// are all free again goes back to the page allocator, unless it is
+// the only partial slab left.
+//
+// In front of the slabs each CPU has a magazine of up to SLAB_MAG
+// free objects, so most allocations and frees only turn interrupts
+// off. An empty magazine is refilled, and a full one flushed, half
+// at a time under the cache lock.
+//
+// Lock order: cache lock, then kmem.lock (kalloc.c).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+#define SLAB_MINOBJS 8
+#define SLAB_MAXORDER 3
+
+struct slab
+{
+  struct kmem_cache *cache;
+  struct slab *next;  // Partial list links
+  struct slab *prev;
+  void *free;         // Free objects, linked through their first word
+  int inuse;          // Objects out of this slab, magazines included
+};
+
+// Set up c for objects of size bytes.
+void kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  initlock(&c->lock, name);
+  c->name = name;
+  if (size < sizeof(void *))
+    size = sizeof(void *);
+  c->size = (size + 3) & ~3;
+  for (c->order = 0;; c->order++)
+  {
+    c->perslab = ((PGSIZE << c->order) - sizeof(struct slab)) / c->size;
+    if (c->perslab >= SLAB_MINOBJS || c->order == SLAB_MAXORDER)
+      break;
+  }
+  if (c->perslab < 1)
+    panic("kmem_cache_init");
+}
+
+static void
+partial_add(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if (s->next)
+    s->next->prev = s;
+  c->partial = s;
+}
+
+static void
+partial_del(struct kmem_cache *c, struct slab *s)
+{
+  if (s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+// Add a new slab to c. c->lock must be held.
+// Returns 0 if out of memory.
+static int
+cache_grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  int i;
+
+  if ((s = (struct slab *)kalloc_pages(c->order)) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  obj = (char *)(s + 1) + (c->perslab - 1) * c->size;
+  for (i = 0; i < c->perslab; i++, obj -= c->size)
+  {
+    *(void **)obj = s->free;
+    s->free = obj;
+  }
+  partial_add(c, s);
+  c->nslabs++;
+  return 1;
+}
+
+// Take one object from c's slabs. c->lock must be held.
+static void *
+slab_get(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if (c->partial == 0 && !cache_grow(c))
+    return 0;
+  s = c->partial;
+  obj = s->free;
+  s->free = *(void **)obj;
+  s->inuse++;
+  if (s->free == 0)
+    partial_del(c, s);
+  return obj;
+}
+
+// Give obj back to its slab. c->lock must be held.
+static void
+slab_put(struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab *)((uint)obj & ~((PGSIZE << c->order) - 1));
+  if (s->cache != c)
+    panic("kmem_cache_free");
+  if (s->free == 0)
+    partial_add(c, s);
+  *(void **)obj = s->free;
+  s->free = obj;
+  // 다 비었으면 하나만 남기고 page allocator에 돌려주기
+  if (--s->inuse == 0 && (c->partial != s || s->next))
+  {
+    partial_del(c, s);
+    c->nslabs--;
+    kfree_pages((char *)s, c->order);
+  }
+}
+
+// Allocate an object from c. Its contents are garbage.
+// Returns 0 if out of memory.
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct kmem_magazine *m;
+  void *obj;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if (m->n == 0)
+  {
+    acquire(&c->lock);
+    while (m->n < SLAB_MAG / 2 && (obj = slab_get(c)) != 0)
+      m->objs[m->n++] = obj;
+    release(&c->lock);
+  }
+  obj = m->n > 0 ? m->objs[--m->n] : 0;
+  popcli();
+  return obj;
+}
+
+// Free obj, which kmem_cache_alloc(c) returned.
+void kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct kmem_magazine *m;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if (m->n == SLAB_MAG)
+  {
+    acquire(&c->lock);
+    while (m->n > SLAB_MAG / 2)
+      slab_put(c, m->objs[--m->n]);
+    release(&c->lock);
+  }
+  m->objs[m->n++] = obj;
+  popcli();
+}
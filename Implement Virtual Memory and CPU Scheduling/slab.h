@@ -0,0 +1,22 @@
+// Object cache for small kernel objects of one size (slab.c).
+// Declare one statically and kmem_cache_init() it once.
+
+#define SLAB_MAG 8 // Objects a CPU keeps at most in its magazine
+
+struct kmem_magazine
+{
+  int n;                 // Objects in objs
+  void *objs[SLAB_MAG];
+};
+
+struct kmem_cache
+{
+  struct spinlock lock;  // Guards the slabs below
+  char *name;
+  uint size;             // Object size in bytes
+  int order;             // Each slab is 2^order pages
+  int perslab;           // Objects per slab
+  struct slab *partial;  // Slabs with free objects
+  int nslabs;            // Slabs taken from kalloc_pages()
+  struct kmem_magazine mag[NCPU]; // Per-CPU free objects, interrupts off
+};
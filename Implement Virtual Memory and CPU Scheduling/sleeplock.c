@@ -6,8 +6,8 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 
 void
@@ -17,28 +17,71 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
 }
 
+// Buffer and inode locks are mostly held briefly, so while the
+// holder is running on another CPU, spin for it up to SPIN_LIMIT
+// pauses before going to sleep, which costs two context switches.
+// The owner is read without lk->lk; a struct proc is always a
+// struct proc, so at worst we misjudge and sleep or spin a bit.
+// Preemption is off while spinning, so the limit bounds the time
+// spent; a pending reschedule ends the spin instead.
+//
+// A holder whose timeslice runs out gets SLEEPLOCK_SLACK more
+// (trap.c), once, and releasing its last sleeplock is then a
+// preemption point where it yields; if the caller still holds a
+// spinlock, the timer preempts it when the slack is over.
+#define SPIN_LIMIT 2000
+
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *owner;
+  int spins;
+
+  preempt_disable();
+  for (spins = 0; lk->locked && spins < SPIN_LIMIT; spins++) {
+    owner = lk->owner;
+    if (owner == 0 || owner->state != RUNNING || resched_pending())
+      break;
+    pause();
+  }
+  preempt_enable();
+
   acquire(&lk->lk);
   while (lk->locked) {
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->owner = myproc();
+  myproc()->nsleeplocks++;
   release(&lk->lk);
 }
 
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+  int resched;
+
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
   wakeup(lk);
   release(&lk->lk);
+
+  // 마지막 sleeplock을 놓았고 timeslice를 넘겨 받았으면 여기서 양보.
+  // 호출한 쪽이 spinlock을 잡고 있으면 다음 timer interrupt에서
+  pushcli();
+  resched = --p->nsleeplocks == 0 && p->lockslack && p->state == RUNNING &&
+            mycpu()->ncli == 1 && mycpu()->intena &&
+            mycpu()->preempt_count == 0;
+  popcli();
+  if (resched)
+    yield();
 }
 
 int
@@ -1,11 +1,16 @@
-// Mutual exclusion lock.
+// Mutual exclusion lock, a ticket lock (spinlock.c).
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;   // Next ticket to hand out
+  volatile uint owner;  // Ticket being served; held while owner != next
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+#ifdef LOCKSTAT
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+  int stat;          // Index of name's counters, or -1 (spinlock.c)
+  uint64 hold_start; // TSC when acquired
+#endif
 };
 
@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
@@ -69,6 +70,10 @@ argptr(int n, char **pp, int size)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  // The kernel may use the buffer with locks held (e.g. pipes),
+  // so fault in any untouched heap pages now.
+  if(lazyfault_range(curproc, i, size) < 0)
+    return -1;
   *pp = (char*)i;
   return 0;
 }
@@ -114,6 +119,17 @@ extern int sys_ps(void);
 extern int sys_mmap(void);
 extern int sys_munmap(void);
 extern int sys_freemem(void);
+extern int sys_idletime(void);
+extern int sys_schedstat(void);
+extern int sys_sched_setscheduler(void);
+extern int sys_sched_setaffinity(void);
+extern int sys_sched_getaffinity(void);
+extern int sys_sched_groupctl(void);
+extern int sys_sched_setgroup(void);
+extern int sys_setmaxproc(void);
+extern int sys_lockstat(void);
+extern int sys_buddyinfo(void);
+extern int sys_untouched(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -144,6 +160,17 @@ static int (*syscalls[])(void) = {
 [SYS_mmap]    sys_mmap,
 [SYS_munmap]  sys_munmap,
 [SYS_freemem] sys_freemem,
+[SYS_idletime] sys_idletime,
+[SYS_schedstat] sys_schedstat,
+[SYS_sched_setscheduler] sys_sched_setscheduler,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_sched_groupctl] sys_sched_groupctl,
+[SYS_sched_setgroup] sys_sched_setgroup,
+[SYS_setmaxproc] sys_setmaxproc,
+[SYS_lockstat] sys_lockstat,
+[SYS_buddyinfo] sys_buddyinfo,
+[SYS_untouched] sys_untouched,
 };
 
 void
@@ -26,4 +26,15 @@
 #define SYS_ps     25
 #define SYS_mmap   26
 #define SYS_munmap 27
-#define SYS_freemem 28
\ No newline at end of file
+#define SYS_freemem 28
+#define SYS_idletime 29
+#define SYS_schedstat 30
+#define SYS_sched_setscheduler 31
+#define SYS_sched_setaffinity 32
+#define SYS_sched_getaffinity 33
+#define SYS_sched_groupctl 34
+#define SYS_sched_setgroup 35
+#define SYS_setmaxproc 36
+#define SYS_lockstat 37
+#define SYS_buddyinfo 38
+#define SYS_untouched 39
\ No newline at end of file
@@ -5,7 +5,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
+#include "schedstat.h"
+#include "lockstat.h"
 
 int sys_fork(void)
 {
@@ -66,7 +69,8 @@ int sys_sleep(void)
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    // timer wheel이 마감 시각에 깨워줌
+    sleep_timeout(&ticks, &tickslock, n - (ticks - ticks0));
   }
   release(&tickslock);
   return 0;
@@ -110,6 +114,55 @@ int sys_setnice(void)
   return setnice(pid, value);
 }
 
+int sys_sched_setscheduler(void)
+{
+  int pid, policy, prio;
+  if (argint(0, &pid) < 0 || argint(1, &policy) < 0 || argint(2, &prio) < 0)
+    return -1;
+  return sched_setscheduler(pid, policy, prio);
+}
+
+int sys_sched_setaffinity(void)
+{
+  int pid, mask;
+  if (argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return sched_setaffinity(pid, mask);
+}
+
+int sys_sched_getaffinity(void)
+{
+  int pid;
+  if (argint(0, &pid) < 0)
+    return -1;
+  return sched_getaffinity(pid);
+}
+
+int sys_sched_groupctl(void)
+{
+  int group, shares, quota, period;
+  if (argint(0, &group) < 0 || argint(1, &shares) < 0 ||
+      argint(2, &quota) < 0 || argint(3, &period) < 0)
+    return -1;
+  return sched_groupctl(group, shares, quota, period);
+}
+
+int sys_sched_setgroup(void)
+{
+  int pid, group;
+  if (argint(0, &pid) < 0 || argint(1, &group) < 0)
+    return -1;
+  return sched_setgroup(pid, group);
+}
+
+int sys_setmaxproc(void)
+{
+  int n;
+  if (argint(0, &n) < 0)
+    return -1;
+  return setmaxproc(n);
+}
+
 int sys_ps(void)
 {
   int pid;
@@ -152,3 +205,56 @@ int sys_freemem(void)
 {
   return freemem();
 }
+// sbrk로 잡았다가 한 번도 안 쓰고 놓은 page 수 (vm.c: lazyfault)
+int sys_untouched(void)
+{
+  return untouched;
+}
+int sys_idletime(void)
+{
+  int cpu;
+  if (argint(0, &cpu) < 0)
+    return -1;
+  return idletime(cpu);
+}
+int sys_schedstat(void)
+{
+  char *buf;
+  int n;
+  if (argint(1, &n) < 0 || n < 0)
+    return -1;
+  // 한 번에 NSCHEDSTAT개까지만 (크기 계산 overflow 방지)
+  if (n > NSCHEDSTAT)
+    n = NSCHEDSTAT;
+  if (argptr(0, &buf, n * sizeof(struct schedstat)) < 0)
+    return -1;
+  return schedstat((uint)buf, n);
+}
+
+int sys_lockstat(void)
+{
+  char *buf;
+  int n;
+  if (argint(1, &n) < 0 || n < 0)
+    return -1;
+  // 이름은 NLOCKSTAT개까지만 (크기 계산 overflow 방지)
+  if (n > NLOCKSTAT)
+    n = NLOCKSTAT;
+  if (argptr(0, &buf, n * sizeof(struct lockstat)) < 0)
+    return -1;
+  return lockstat((uint)buf, n);
+}
+
+int sys_buddyinfo(void)
+{
+  char *buf;
+  int n;
+  if (argint(1, &n) < 0 || n < 0)
+    return -1;
+  // order는 0..MAXORDER뿐 (크기 계산 overflow 방지)
+  if (n > MAXORDER + 1)
+    n = MAXORDER + 1;
+  if (argptr(0, &buf, n * sizeof(int)) < 0)
+    return -1;
+  return buddyinfo((uint)buf, n);
+}
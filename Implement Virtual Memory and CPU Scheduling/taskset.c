@@ -0,0 +1,48 @@
+// taskset pid
+// taskset mask pid
+// Print the set of CPUs pid may run on, or restrict it to mask
+// (decimal, bit n = CPU n). A mask of "ide" means the CPU that
+// takes disk interrupts, for pinning I/O-bound daemons next to it.
+
+#include "types.h"
+#include "user.h"
+
+// Mask with only the last CPU, which ideinit() routes IRQ_IDE to.
+int
+idemask(void)
+{
+  int mask, bit;
+
+  mask = sched_getaffinity(getpid());
+  for(bit = 1; mask >> 1; mask >>= 1)
+    bit <<= 1;
+  return bit;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mask, pid;
+
+  if(argc == 2){
+    pid = atoi(argv[1]);
+    if((mask = sched_getaffinity(pid)) < 0){
+      printf(2, "taskset: no process %d\n", pid);
+      exit();
+    }
+    printf(1, "pid %d mask %d\n", pid, mask);
+    exit();
+  }
+  if(argc != 3){
+    printf(2, "usage: taskset [mask|ide] pid\n");
+    exit();
+  }
+  if(strcmp(argv[1], "ide") == 0)
+    mask = idemask();
+  else
+    mask = atoi(argv[1]);
+  pid = atoi(argv[2]);
+  if(sched_setaffinity(pid, mask) < 0)
+    printf(2, "taskset: cannot set pid %d to mask %d\n", pid, mask);
+  exit();
+}
@@ -3,16 +3,27 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[]; // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
+// CPU 0 keeps ticks from the TSC: tick_stamp has been
+// consumed up to now - tick_frac milliticks into the current tick.
+static uint64 tick_stamp;
+static uint tick_frac;
+
+// Milliticks short of the timeslice that still count as its end.
+#define SLICE_SLACK 5
+// Milliticks a process holding a sleeplock may run past its
+// timeslice, once, so it can reach releasesleep() and yield there
+// instead of making the lock's waiters sleep through its preemption.
+#define SLEEPLOCK_SLACK 1000
 
 void tvinit(void)
 {
@@ -23,6 +34,7 @@ void tvinit(void)
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE << 3, vectors[T_SYSCALL], DPL_USER);
 
   initlock(&tickslock, "time");
+  tick_stamp = rdtsc();
 }
 
 void idtinit(void)
@@ -30,6 +42,58 @@ void idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// Advance ticks by the whole ticks that have passed. CPU 0 only.
+static void
+clockupdate(void)
+{
+  int advanced = 0;
+
+  acquire(&tickslock);
+  tick_frac += mticks_consume(&tick_stamp);
+  while (tick_frac >= 1000)
+  {
+    ticks++;
+    tick_frac -= 1000;
+    advanced = 1;
+  }
+  release(&tickslock);
+  // 마감 시각이 된 sleep만 깨우기
+  if (advanced)
+    run_timers();
+}
+
+// Arm this CPU's one-shot timer for its next event: the end of
+// the running timeslice, slice milliticks from now (0 if idle),
+// and on CPU 0 also the next tick. Other CPUs take no timer
+// interrupts while idle. Interrupts must be disabled.
+void set_next_event(uint slice)
+{
+  uint next = slice, elapsed;
+
+  if (cpuid() == 0)
+  {
+    elapsed = tick_frac + mticks_since(tick_stamp);
+    elapsed = elapsed < 1000 ? 1000 - elapsed : 1;
+    if (next == 0 || elapsed < next)
+      next = elapsed;
+  }
+  lapiconeshot(next);
+}
+
+// Yield if a wakeup asked this CPU to reschedule,
+// unless preemption is disabled (preempt_enable yields then).
+static void
+check_resched(void)
+{
+  int resched;
+
+  pushcli();
+  resched = mycpu()->need_resched && mycpu()->preempt_count == 0;
+  popcli();
+  if (resched && myproc() && myproc()->state == RUNNING)
+    yield();
+}
+
 // PAGEBREAK: 41
 void trap(struct trapframe *tf)
 {
@@ -48,6 +112,8 @@ void trap(struct trapframe *tf)
     // syscall 수행 후 죽었는지 확인
     if (myproc()->killed)
       exit();
+    // 깨운 프로세스가 선점을 요청했으면 양보
+    check_resched();
 
     return;
   }
@@ -58,12 +124,9 @@ void trap(struct trapframe *tf)
     // TIMER INTR
   case T_IRQ0 + IRQ_TIMER:
     if (cpuid() == 0)
-    {
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+      clockupdate();
+    // 주기적으로 CPU 간 runqueue 길이 맞추기
+    load_balance();
     lapiceoi();
     break;
     // DISK INTR
@@ -89,10 +152,28 @@ void trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+    // RESCHED IPI
+  case T_IRQ0 + IRQ_RESCHED:
+    // 다른 CPU가 이 CPU의 runqueue에 넣어줬음 -> hlt에서 깨거나
+    // need_resched 보고 아래에서 양보
+    lapiceoi();
+    break;
+
   case T_PGFLT:
     err = tf->err & 2 ? 2 : 1;
     if(page_fault_handler(rcr2(),err) != -1)
       break;
+    // 처리 못한 user page fault (heap 밖, mmap 권한 위반, 메모리 부족)
+    // -> 그냥 돌아가면 같은 fault만 반복하니 죽이기
+    if (myproc() && (tf->cs & 3) == DPL_USER)
+    {
+      cprintf("pid %d %s: page fault err %d on cpu %d "
+              "eip 0x%x addr 0x%x--kill proc\n",
+              myproc()->pid, myproc()->name, tf->err, cpuid(), tf->eip,
+              rcr2());
+      myproc()->killed = 1;
+      break;
+    }
     // 예기치 못한 INTR
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
@@ -124,35 +205,44 @@ void trap(struct trapframe *tf)
   if (myproc() && myproc()->killed && (tf->cs & 3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU when its timeslice is over.
   // If interrupts were on while locks held, would need to check nlock.
-  if (myproc() && myproc()->state == RUNNING && tf->trapno == T_IRQ0 + IRQ_TIMER)
+  if (tf->trapno == T_IRQ0 + IRQ_TIMER)
   {
-    /*
-    1. 전에 timetick을 쓴만큼 aruntime update - 1tick추가
-    2. 흐른 시간만큼 업데이트
-    3. 현재 가중치로 vruntime 계산
-    */
-    // 1. 실제 시간 계산
-    myproc()->aruntime += 1000;
-    // 2. 얼만큼 흘렀는지 계산(aruntime_prev - aruntime)
-    uint temp = myproc()->aruntime - myproc()->aruntime_prev;
-    // 3. 현재 nice값 기반 가중치로 vruntime 계산
-    myproc()->vruntime_low += 1024000 / myproc()->weight;
-    if ((uint)(myproc()->vruntime_low / 1000000000))
+    if (myproc() && myproc()->state == RUNNING)
     {
-      myproc()->vruntime_low %= 1000000000;
-      myproc()->vruntime_high++;
-    }
-    // 4. 이번에 쓴 밀리틱이랑 처음에 스케줄될때 정해졌던 timeslice 비교
-    if (temp >= myproc()->timeslice)
-    {
-      // timeslice가 만약에 작으면? 양보 -> aruntime_prev 업데이트
-      myproc()->aruntime_prev = myproc()->aruntime;
-      yield();
+      /*
+      1. TSC로 잰 만큼 aruntime, vruntime update
+      2. 이번에 CPU 잡고 나서 얼만큼 썼는지 계산
+      3. timeslice 다 썼으면 양보, 아니면 남은 시간 뒤에 timer 다시
+      */
+      // 1. 실제 시간, 가상 시간 계산
+      update_curr(myproc());
+      // 2. 얼만큼 흘렀는지 계산(aruntime - aruntime_prev)
+      uint temp = myproc()->aruntime - myproc()->aruntime_prev;
+      // 3. 이번에 쓴 밀리틱이랑 처음에 스케줄될때 정해졌던 timeslice 비교
+      //    (timer와 TSC 반올림 차이만큼은 다 쓴 걸로)
+      if (temp + SLICE_SLACK < myproc()->timeslice)
+        set_next_event(myproc()->timeslice - temp);
+      else if (mycpu()->preempt_count)
+        set_next_event(SLICE_SLACK); // 선점 금지 구간 -> 조금 있다 다시
+      else if (myproc()->nsleeplocks && !myproc()->lockslack)
+      {
+        // sleeplock 잡고 있음 -> 한 번만 조금 더 주고 releasesleep에서 양보
+        // (lockslack은 scheduler가 다시 고를 때 0으로)
+        myproc()->lockslack = 1;
+        set_next_event(SLEEPLOCK_SLACK);
+      }
+      else
+        yield();
     }
+    else
+      set_next_event(0);
   }
 
+  // 깨운 프로세스가 선점을 요청했으면 양보 (IRQ_RESCHED IPI 포함)
+  check_resched();
+
   // Check if the process has been killed since we yielded
   if (myproc() && myproc()->killed && (tf->cs & 3) == DPL_USER)
     exit();
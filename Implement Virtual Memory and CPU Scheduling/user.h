@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct schedstat;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -30,6 +32,17 @@ void ps(int);
 uint mmap(uint, int, int, int, int, int);
 int munmap(uint);
 int freemem();
+int idletime(int);
+int schedstat(struct schedstat*, int);
+int sched_setscheduler(int, int, int);
+int sched_setaffinity(int, uint);
+int sched_getaffinity(int);
+int sched_groupctl(int, int, int, int);
+int sched_setgroup(int, int);
+int setmaxproc(int);
+int lockstat(struct lockstat*, int);
+int buddyinfo(int*, int);
+int untouched(void);
 // ulib.c
 int stat(const char *, struct stat *);
 char *strcpy(char *, const char *);
@@ -1509,6 +1509,22 @@ sbrktest(void)
     wait();
   }
 
+  // is the page past the break unmapped, even though sbrk() now
+  // maps heap pages only when first touched?
+  a = (char*)(((uint)sbrk(0) + 4095) & ~4095);
+  ppid = getpid();
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    printf(stdout, "oops could read past break %x = %x\n", a, *a);
+    kill(ppid);
+    exit();
+  }
+  wait();
+
   // if we run the system out of memory, does it clean up the last
   // failed allocation?
   if(pipe(fds) != 0){
@@ -4,12 +4,13 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h" //SPINLOCK 사용
 #include "proc.h"
 #include "elf.h"
-#include "spinlock.h" //SPINLOCK 사용
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"     //File Offset 설정용
+#include "slab.h"
 
 extern char data[]; // defined by kernel.ld
 pde_t *kpgdir;      // for use in scheduler()
@@ -24,12 +25,21 @@ void seginit(void)
   // Cannot share a CODE descriptor for both kernel and user
   // because it would have to have DPL_USR, but the CPU forbids
   // an interrupt from CPL=0 to DPL=3.
-  c = &cpus[cpuid()];
+  // %gs isn't set up yet, so mycpu() can't be used: find this
+  // CPU by its APIC ID.
+  for (c = cpus; c < &cpus[ncpu] && c->apicid != lapicid(); c++)
+    ;
+  if (c == &cpus[ncpu])
+    panic("seginit: unknown apicid");
   c->gdt[SEG_KCODE] = SEG(STA_X | STA_R, 0, 0xffffffff, 0);
   c->gdt[SEG_KDATA] = SEG(STA_W, 0, 0xffffffff, 0);
   c->gdt[SEG_UCODE] = SEG(STA_X | STA_R, 0, 0xffffffff, DPL_USER);
   c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
+  // Per-CPU data: %gs:0 is c->self, %gs:4 is c->proc (mycpu, myproc).
+  c->gdt[SEG_KCPU] = SEG(STA_W, c, sizeof(*c), 0);
   lgdt(c->gdt, sizeof(c->gdt));
+  c->self = c;
+  loadgs(SEG_KCPU << 3);
 }
 
 // Return the address of the PTE in page table pgdir
@@ -300,6 +310,78 @@ int deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// sbrk() only reserves address space (growproc); a heap page is
+// allocated and zeroed when first touched (lazyfault). untouched
+// counts the reserved pages given back, by sbrk() or along with the
+// whole address space, without ever having been touched.
+uint untouched;
+
+// Map a zeroed page at va if it is a reserved heap page of p that
+// was never touched. Returns 1 if it did, 0 otherwise.
+int lazyfault(struct proc *p, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  if (va >= p->sz)
+    return 0;
+  pte = walkpgdir(p->pgdir, (char *)va, 0);
+  if (pte && (*pte & PTE_P))
+    return 0;
+  if ((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  if (mappages(p->pgdir, (char *)va, PGSIZE, V2P(mem), PTE_W | PTE_U) < 0)
+  {
+    kfree(mem);
+    return 0;
+  }
+  return 1;
+}
+
+// Touch the reserved heap pages of p in [va, va + n), so the kernel
+// can then use them with locks held (argptr). Returns -1 if out of
+// memory.
+int lazyfault_range(struct proc *p, uint va, uint n)
+{
+  pte_t *pte;
+  uint a;
+
+  for (a = PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+  {
+    pte = walkpgdir(p->pgdir, (char *)a, 0);
+    if ((pte == 0 || !(*pte & PTE_P)) && !lazyfault(p, a))
+      return -1;
+  }
+  return 0;
+}
+
+// Add the never touched reserved pages in [lo, hi) to untouched.
+// Call before the pages go away.
+void lazyrelease(pde_t *pgdir, uint lo, uint hi)
+{
+  pte_t *pte;
+  uint a, next, n = 0;
+
+  for (a = PGROUNDUP(lo); a < hi; a += PGSIZE)
+  {
+    pte = walkpgdir(pgdir, (char *)a, 0);
+    if (pte == 0)
+    {
+      // page table째로 없음 -> 다음 page table까지 다 안 쓴 page
+      next = PGADDR(PDX(a) + 1, 0, 0);
+      if (next > hi)
+        next = PGROUNDUP(hi);
+      n += (next - a) / PGSIZE;
+      a = next - PGSIZE;
+    }
+    else if (!(*pte & PTE_P))
+      n++;
+  }
+  __sync_fetch_and_add(&untouched, n);
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void freevm(pde_t *pgdir)
@@ -346,10 +428,9 @@ copyuvm(pde_t *pgdir, uint sz)
     return 0;
   for (i = 0; i < sz; i += PGSIZE)
   {
-    if ((pte = walkpgdir(pgdir, (void *)i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if (!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+    // 아직 안 쓴 heap page는 자식도 처음 쓸 때 할당
+    if ((pte = walkpgdir(pgdir, (void *)i, 0)) == 0 || !(*pte & PTE_P))
+      continue;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
     if ((mem = kalloc()) == 0)
@@ -376,7 +457,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if ((*pte & PTE_P) == 0)
+  if (pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if ((*pte & PTE_U) == 0)
     return 0;
@@ -431,24 +512,41 @@ struct mmap_area
   int flags;           // MAP_POPULATE, 0, MAP_POPULATE|MAP_ANONYMOUS
   struct proc *p;      // 해당 프로세스
   enum memstate state; // 현재 이 페이지 사용하고 있는지
+  struct mmap_area *next; // mtable 리스트 링크
 };
+// mmap_area들은 mapcache에서 필요할 때마다 받아서 리스트로 관리
 struct
 {
   struct spinlock lock; // page lock
-  struct mmap_area maps[64];
+  struct mmap_area *maps;
 } mtable;
+static struct kmem_cache mapcache;
+
+void mmapinit(void)
+{
+  initlock(&mtable.lock, "mtable");
+  kmem_cache_init(&mapcache, "mapcache", sizeof(struct mmap_area));
+}
+// 새 mmap_area를 0으로 채워서 mtable에 넣기. mtable.lock 잡고 호출
+// 메모리가 없으면 0
 struct mmap_area *mallock()
 {
   struct mmap_area *map;
-  acquire(&mtable.lock);
-  for (map = mtable.maps; map < &mtable.maps[64]; map++)
-    if (map->state == 0)
-    {
-      release(&mtable.lock);
-      return map;
-    }
-  release(&mtable.lock);
-  return 0;
+  if ((map = kmem_cache_alloc(&mapcache)) == 0)
+    return 0;
+  memset(map, 0, sizeof(*map));
+  map->next = mtable.maps;
+  mtable.maps = map;
+  return map;
+}
+// map을 mtable에서 빼고 반납. mtable.lock 잡고 호출
+void mfree(struct mmap_area *map)
+{
+  struct mmap_area **pp;
+  for (pp = &mtable.maps; *pp != map; pp = &(*pp)->next)
+    ;
+  *pp = map->next;
+  kmem_cache_free(&mapcache, map);
 }
 int compare_prot(struct mmap_area *mmap)
 {
@@ -551,7 +649,7 @@ int page_fault_handler(uint addr, int io)
   char *page;
   int prot;
   acquire(&mtable.lock);
-  for (mmap = mtable.maps; mmap < &mtable.maps[64]; mmap++)
+  for (mmap = mtable.maps; mmap; mmap = mmap->next)
   {
     if (mmap->addr <= addr && mmap->addr + mmap->length > addr && mmap->p == myproc() && mmap->state)
     {
@@ -592,6 +690,9 @@ int page_fault_handler(uint addr, int io)
     }
   }
   release(&mtable.lock);
+  // mmap 영역이 아니면 sbrk로 잡아만 둔 heap page인지
+  if (myproc() && lazyfault(myproc(), addr))
+    return 1;
   return -1;
 }
 uint mmap(uint addr, int length, int prot, int flags, int fd, int offset)
@@ -610,14 +711,14 @@ uint mmap(uint addr, int length, int prot, int flags, int fd, int offset)
   }
   else
   {
-    if (fd < 0) // Ensure valid file descriptor for file mapping
+    if (fd < 0 || fd >= NOFILE || myproc()->ofile[fd] == 0) // Ensure valid file descriptor for file mapping
       return 0;
   }
 
-  // 2. Check mmap_area array
+  // 2. Check mmap_area list
   struct mmap_area *mmap;
   acquire(&mtable.lock);
-  for (mmap = mtable.maps; mmap < &mtable.maps[64]; mmap++)
+  for (mmap = mtable.maps; mmap; mmap = mmap->next)
   {
     if (mmap->addr <= (addr + MMAPBASE) && mmap->addr + mmap->length > (addr + MMAPBASE) && mmap->state == USING && mmap->p == myproc())
     {
@@ -626,10 +727,12 @@ uint mmap(uint addr, int length, int prot, int flags, int fd, int offset)
       return 0;
     }
   }
-  release(&mtable.lock);
 
   // 3.Init mmap_area
   mmap = mallock();
+  release(&mtable.lock);
+  if (mmap == 0)
+    return 0;
   mmap->f = 0; // 일단 파일 0으로 초기화
   mmap->addr = addr + MMAPBASE;
   mmap->length = length;
@@ -646,7 +749,9 @@ uint mmap(uint addr, int length, int prot, int flags, int fd, int offset)
     {
       if(!map_populate_annonymous(mmap))
       {
-        mmap->state = UNUSING;
+        acquire(&mtable.lock);
+        mfree(mmap);
+        release(&mtable.lock);
         return 0;
       }
     }
@@ -655,16 +760,14 @@ uint mmap(uint addr, int length, int prot, int flags, int fd, int offset)
     {
       // 1. INIT MMAP with FILE
       mmap->offset = offset;
-      mmap->f = mmap->p->ofile[fd];
+      mmap->f = filedup(mmap->p->ofile[fd]); // close(fd) 후에도 mapping이 파일을 잡고 있게
       mmap->f->off = offset;
-      if (!compare_prot(mmap))
-      {
-        mmap->state = UNUSING;
-        return 0;
-      }
-      if(!map_populate(mmap))
+      if (!compare_prot(mmap) || !map_populate(mmap))
       {
-        mmap->state = UNUSING;
+        acquire(&mtable.lock);
+        mfree(mmap);
+        release(&mtable.lock);
+        fileclose(mmap->f);
         return 0;
       }
     }
@@ -672,12 +775,15 @@ uint mmap(uint addr, int length, int prot, int flags, int fd, int offset)
   else // MAP_POPULATE이 없는 경우
   // mmap(0,8192,PROT_READ, 0, fd, 4096)
   {
-    mmap->f = mmap->p->ofile[fd];
+    mmap->f = filedup(mmap->p->ofile[fd]); // close(fd) 후에도 mapping이 파일을 잡고 있게
     mmap->offset = offset;
     mmap->f->off = offset;
     if (!compare_prot(mmap))
     {
-      mmap->state = UNUSING;
+      acquire(&mtable.lock);
+      mfree(mmap);
+      release(&mtable.lock);
+      fileclose(mmap->f);
       return 0;
     }
   }
@@ -688,10 +794,11 @@ uint mmap(uint addr, int length, int prot, int flags, int fd, int offset)
 int munmap(uint addr)
 {
   struct mmap_area *map;
+  struct file *f;
   pte_t *pte = 0;
   // mmap_area 순회
   acquire(&mtable.lock);
-  for (map = mtable.maps; map < &mtable.maps[64]; map++)
+  for (map = mtable.maps; map; map = map->next)
   {
     // 주어진 주소가 있다면?
     if (map->addr <= (addr+MMAPBASE) && map->addr + map->length >= (addr+MMAPBASE) && map->state == USING && map->p == myproc())
@@ -710,15 +817,12 @@ int munmap(uint addr)
           *pte = *pte & 0x0;
         }
       }
-      map->f = 0;
-      map->addr = 0;
-      map->length = 0;
-      map->offset = 0;
-      map->prot = 0;
-      map->flags = 0;
-      map->p = 0;
-      map->state = UNUSING;
+      // fileclose는 sleep할 수 있으니 mtable.lock 놓고
+      f = map->f;
+      mfree(map);
       release(&mtable.lock);
+      if (f)
+        fileclose(f);
       return 1;
     }
   }
@@ -726,32 +830,32 @@ int munmap(uint addr)
   return -1;
 }
 
-int freemem()
-{
-  return freemems;
-}
 int map_fork(struct proc *proc)
 {
   struct mmap_area *map;
-  struct mmap_area *temp_map;
+  struct mmap_area *temp_map, *next;
   pte_t *pte;
   acquire(&mtable.lock);
 
   // Iterate
-  for (map = mtable.maps; map < &mtable.maps[64]; map++)
+  for (map = mtable.maps; map; map = map->next)
   {
     if (map->state==USING && map->p == myproc())
     {
-      // 새 매핑을 위한 공간을 할당
-      temp_map = mallock();
+      // 새 매핑을 위한 공간을 할당 (리스트 맨 앞에 들어가니까 이 순회에서는 안 보임)
+      if ((temp_map = mallock()) == 0)
+        break;
 
-      // 매핑된 영역의 속성을 복사
+      // 매핑된 영역의 속성을 복사 (리스트 링크는 그대로)
+      next = temp_map->next;
       *temp_map = *map;
+      temp_map->next = next;
       temp_map->p = proc;  // 새 프로세스를 위한 소유권 설정
       temp_map->state = USING; // 활성 상태로 설정
       if (map->f)
       {
-        // 파일이 있는 경우, 파일 오프셋을 설정
+        // 파일이 있는 경우, 자식 mapping도 파일 reference를 하나 갖고 오프셋을 설정
+        filedup(temp_map->f);
         temp_map->f->off = temp_map->offset;
       }
 
@@ -785,3 +889,30 @@ int map_fork(struct proc *proc)
   release(&mtable.lock);
   return 1; // 성공적으로 매핑이 완료
 }
+
+// exit: p의 mmap_area를 전부 반납하고 파일 reference를 놓는다.
+// page는 freevm이 같이 해제. fileclose는 sleep할 수 있으니
+// 하나씩 빼서 mtable.lock 놓고 닫기
+void map_exit(struct proc *p)
+{
+  struct mmap_area *map;
+  struct file *f;
+
+  for (;;)
+  {
+    acquire(&mtable.lock);
+    for (map = mtable.maps; map; map = map->next)
+      if (map->state == USING && map->p == p)
+        break;
+    if (map == 0)
+    {
+      release(&mtable.lock);
+      return;
+    }
+    f = map->f;
+    mfree(map);
+    release(&mtable.lock);
+    if (f)
+      fileclose(f);
+  }
+}
@@ -119,6 +119,15 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and halt until the next one. Interrupts are
+// only recognized after the instruction following sti, so one
+// that arrives in between still ends the hlt.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -132,6 +141,35 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add val to *addr, returning the old value.
+static inline uint
+xadd(volatile uint *addr, uint val)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (val), "+m" (*addr) :
+               :
+               "memory", "cc");
+  return val;
+}
+
+// Spin-wait hint, so a waiting CPU eases off the memory bus.
+// Also makes the compiler reread memory in the wait loop.
+static inline void
+pause(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
+// Read the time-stamp counter.
+static inline uint64
+rdtsc(void)
+{
+  uint64 val;
+
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -9,6 +9,7 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
 
 // bio.c
 void            binit(void);
@@ -77,6 +78,11 @@ void            clear_bit(int index);
 int             check_bit(int index);
 int             find_free_swap_index(void);
 void            append_lru (pde_t *pgdir, uint va, uint pa);
+void            drop_lru(pde_t *pgdir, uint va, uint pa);
+void            page_put(uint pa);
+void            swap_put(int index);
+void            cow_share(pte_t *pte, pte_t *npte);
+int             cow_fault(pde_t *pgdir, uint va, pte_t *pte);
 void            pop_lru(uint pa);
 
 // kbd.c
@@ -126,9 +132,11 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+int             sleep_timeout(void*, struct spinlock*, uint);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+void            wakeup_one(void*);
 void            yield(void);
 
 // swtch.S
@@ -139,6 +147,8 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstat(uint, int);
+void            latencydump(void);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
@@ -168,13 +178,16 @@ void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+void            add_timer(struct timer*);
+int             del_timer(struct timer*);
+void            run_timers(void);
 
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
-int page_fault_hadler(pde_t *pgdir, uint vaddr);
+int page_fault_hadler(pde_t *pgdir, uint vaddr, int write);
 
 // uart.c
 void uartinit(void);
@@ -196,6 +209,10 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             lazyfault(struct proc*, uint);
+int             lazyfault_range(struct proc*, uint, uint);
+void            lazyrelease(pde_t*, uint, uint);
+extern uint     untouched;
 pte_t *walkpgdir(pde_t *pgdir, const void *va, int alloc);
 void flush(void);
 
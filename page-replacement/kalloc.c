@@ -33,6 +33,7 @@ int num_free_pages;
 int num_lru_pages;
 struct spinlock lru_lock; // lru 접근 락
 char bitmap[BITMAP_SIZE]; //bitmap 공간
+int swap_refcnt[BITMAP_SIZE]; // swap slot을 가리키는 PTE 수 (COW fork)
 
 /*
 고려사항
@@ -73,6 +74,95 @@ int find_free_swap_index(void){
   return -1; 
 }
 
+// COW fork로 공유되는 page와 swap slot의 reference count.
+// PTE 하나가 가리킬 때마다 1, 0이 되면 free (vm.c: copyuvm)
+// refcnt를 보고 PTE를 바꾸는 쪽(cow_share, cow_fault, reclaim)이 서로
+// 끼어들지 못하게 refcnt는 lru_lock 아래에서만 바꾼다.
+void page_put(uint pa)
+{
+  int n;
+
+  acquire(&lru_lock);
+  n = --pages[pa / PGSIZE].refcnt;
+  release(&lru_lock);
+  if (n == 0)
+    kfree(P2V(pa));
+}
+void swap_put(int index)
+{
+  acquire(&lru_lock);
+  if (--swap_refcnt[index] == 0)
+    clear_bit(index);
+  release(&lru_lock);
+}
+
+// fork: 부모의 pte가 가리키는 page나 swap slot을 자식의 npte와 공유.
+// 쓰기 가능한 page는 둘 다 읽기 전용 + COW로 (vm.c: copyuvm)
+void cow_share(pte_t *pte, pte_t *npte)
+{
+  acquire(&lru_lock);
+  if (*pte & PTE_W)
+    *pte = (*pte & ~PTE_W) | PTE_COW;
+  if (*pte & PTE_P)
+    pages[PTE_ADDR(*pte) / PGSIZE].refcnt++;
+  else // Swap space라면? swap slot을 같이 쓰기
+    swap_refcnt[*pte >> 12]++;
+  *npte = *pte;
+  release(&lru_lock);
+}
+
+// COW page(pgdir의 va, pte)에 쓰기 전에 내 것으로 만들기.
+// trap.c의 page fault와, P2V로 써서 fault가 안 나는 copyout에서 부른다.
+// 1. 나만 쓰고 있으면 복사 없이 그냥 쓰기 가능하게
+// 2. 아직 다른 프로세스도 쓰고 있으면 새 page에 복사해서 내 것으로
+// 실패(메모리 부족)하면 0
+int cow_fault(pde_t *pgdir, uint va, pte_t *pte)
+{
+  uint pa;
+  char *mem;
+  int n;
+
+  //1. 나만 쓰는 중
+  acquire(&lru_lock);
+  pa = PTE_ADDR(*pte);
+  if (pages[pa / PGSIZE].refcnt == 1)
+  {
+    *pte = (*pte & ~PTE_COW) | PTE_W;
+    release(&lru_lock);
+    append_lru(pgdir, va, pa);
+    flush();
+    return 1;
+  }
+  release(&lru_lock);
+
+  //2. 복사 (kalloc은 reclaim으로 lru_lock을 잡을 수 있어서 락 밖에서)
+  if ((mem = kalloc()) == 0)
+  {
+    cprintf("Out of Memory\n");
+    return 0;
+  }
+  memmove(mem, P2V(pa), PGSIZE);
+  acquire(&lru_lock);
+  if (!(*pte & PTE_P) || PTE_ADDR(*pte) != pa)
+  {
+    // 그 사이 공유가 풀려서 swap out됨 -> 복사본은 버리고 다시 fault
+    release(&lru_lock);
+    kfree(mem);
+    return 1;
+  }
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  n = --pages[pa / PGSIZE].refcnt;
+  release(&lru_lock);
+  drop_lru(pgdir, va, pa);
+  if (n == 0)
+    kfree(P2V(pa));
+  append_lru(pgdir, va, V2P(mem));
+  flush();
+  return 1;
+}
+
+// LRU에는 physical page마다 그 page를 mapping한 PTE 하나(pgdir, va)만 들어간다.
+// 이미 들어있는 page면 (pgdir, va)만 바꾼다.
 void append_lru(pde_t *pgdir, uint va, uint pa)
 {
   // 1. page 선택
@@ -80,9 +170,16 @@ void append_lru(pde_t *pgdir, uint va, uint pa)
 
   // 2. 락 걸고 할당
   acquire(&lru_lock);
+  if (newPage->pgdir != 0) // 이미 LRU에 있음
+  {
+    newPage->vaddr = (char *)va;
+    newPage->pgdir = pgdir;
+    release(&lru_lock);
+    return;
+  }
   newPage->vaddr = (char *)va;
   newPage->pgdir = pgdir;
-  if (num_lru_pages == 1) // 현재 한장
+  if (page_lru_head == 0) // 첫 한장
   {
     page_lru_head = newPage;
     newPage->prev = newPage;
@@ -107,30 +204,41 @@ void pop_lru(uint pa)
 
   // 2. 락걸고 삭제
   acquire(&lru_lock);
-  if (deletePage == page_lru_head)
+  if (deletePage->next == deletePage) // 마지막 한장
     page_lru_head = 0; // 초기화
   else
   {
+    if (deletePage == page_lru_head)
+      page_lru_head = deletePage->next;
     // 이어주고
     deletePage->prev->next = deletePage->next;
     deletePage->next->prev = deletePage->prev;
-    // 삭제
-    deletePage->next = 0;
-    deletePage->prev = 0;
-    deletePage->vaddr = 0;
-    deletePage->pgdir = 0;
   }
+  // 삭제
+  deletePage->next = 0;
+  deletePage->prev = 0;
+  deletePage->vaddr = 0;
+  deletePage->pgdir = 0;
   // 3. 해제
   num_lru_pages--;
   release(&lru_lock);
   return;
 }
+// pa의 LRU 항목이 (pgdir, va)이면 빼기
+void drop_lru(pde_t *pgdir, uint va, uint pa)
+{
+  struct page *page = &pages[pa / PGSIZE];
+
+  if (page->pgdir == pgdir && page->vaddr == (char *)va)
+    pop_lru(pa);
+}
 int reclaim()
 {
   cprintf("130\n");
   // 현재 빈 페이지가 없어서 clock algorithm에 따른 Swap out을 수행해 페이지를 만들어야 되는 상황
   acquire(&lru_lock);
   pte_t *targetPte; 
+  int scanned = 0;
   // 1. swap out 할 페이지가 없는 경우
   if(num_lru_pages == 0)
   {
@@ -140,6 +248,20 @@ int reclaim()
   }
   while(1)
   {
+    // 다 공유 중이라 내보낼 page가 없는 경우
+    if(scanned++ > 2 * num_lru_pages)
+    {
+      cprintf("Out of Memory\n");
+      release(&lru_lock);
+      return 0;
+    }
+    // COW로 공유 중인 page는 PTE 하나만 바꿔서 내보낼 수 없으니 건너뛰기
+    // (lru_lock을 잡고 있으니 PTE를 바꿀 때까지 fork가 공유하지 못함)
+    if(page_lru_head->refcnt > 1)
+    {
+      page_lru_head = page_lru_head->next;
+      continue;
+    }
     //Page entry 찾기
     targetPte = walkpgdir(page_lru_head->pgdir, (char*)PGROUNDDOWN((uint)(void *)page_lru_head->vaddr), 0);
     //Reference bit 구하기
@@ -168,11 +290,17 @@ int reclaim()
         return 0;
       }
 
-      //Victim page을 swap space에 쓰기
-      char *vaddr = targetPage->vaddr;
-      swapwrite(vaddr, swap_index);
+      //Victim page을 swap space에 쓰기 (다른 프로세스 page일 수 있으니 kernel 주소로)
+      uint pa = PTE_ADDR(*targetPte);
+      swapwrite(P2V(pa), swap_index);
       //swap bitmap 관리
       set_bit(swap_index);
+      swap_refcnt[swap_index] = 1;
+      targetPage->next = 0;
+      targetPage->prev = 0;
+      targetPage->vaddr = 0;
+      targetPage->pgdir = 0;
+      num_lru_pages--;
 
       //Update the PTE and PTE_P clear
       uint flags = PTE_FLAGS(*targetPte);
@@ -186,7 +314,7 @@ int reclaim()
 
       //Physical page free
       release(&kmem.lock);
-      kfree(P2V(PTE_ADDR(*targetPte)));
+      kfree(P2V(pa));
       break;
     }
   }
@@ -270,7 +398,10 @@ try_again:
   if (!r && reclaim())
     goto try_again;
   if (r)
+  {
     kmem.freelist = r->next;
+    pages[V2P(r) / PGSIZE].refcnt = 1;
+  }
   if (kmem.use_lock)
     release(&kmem.lock);
   return (char *)r;
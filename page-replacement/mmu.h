@@ -17,9 +17,10 @@
 #define SEG_UCODE 3  // user code
 #define SEG_UDATA 4  // user data+stack
 #define SEG_TSS   5  // this process's task state
+#define SEG_KCPU  6  // this CPU's struct cpu, loaded in %gs
 
 // cpu->gdt[NSEGS] holds the above segments.
-#define NSEGS     6
+#define NSEGS     7
 
 #ifndef __ASSEMBLER__
 // Segment Descriptor
@@ -96,6 +97,7 @@ struct segdesc {
 #define PTE_U           0x004   // User
 #define PTE_PS          0x080   // Page Size
 #define PTE_A           0x20    // Accessed bit in each PTE
+#define PTE_COW         0x200   // Copy-on-write, read-only until written (trap.c)
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
@@ -184,6 +186,7 @@ struct page{
 	struct page *prev; //이전 페이지
 	pde_t *pgdir; //해당하는 프로세스
 	char *vaddr; //Virtual Address로 전환
+	int refcnt; //이 page를 가리키는 PTE 수 (COW fork)
 };
 
 
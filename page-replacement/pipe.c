@@ -2,9 +2,9 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
 
@@ -84,6 +84,8 @@ pipewrite(struct pipe *p, char *addr, int n)
   for(i = 0; i < n; i++){
     while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
+        // Pass on the wakeup piperead() may have given us.
+        wakeup_one(&p->nwrite);
         release(&p->lock);
         return -1;
       }
@@ -115,7 +117,7 @@ piperead(struct pipe *p, char *addr, int n)
       break;
     addr[i] = p->data[p->nread++ % PIPESIZE];
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  wakeup_one(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
   return i;
 }
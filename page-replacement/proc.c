@@ -4,12 +4,24 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+
+// Sleeping processes are kept on wait queues hashed by chan,
+// so wakeup() only looks at processes that may be sleeping on it.
+#define WAITQ_SHIFT 6
+#define NWAITQ (1 << WAITQ_SHIFT)
+
+struct waitqueue {
+  struct proc *head;  // Longest sleeper first
+  struct proc *tail;
+};
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct waitqueue waitq[NWAITQ];
 } ptable;
 
 static struct proc *initproc;
@@ -20,10 +32,57 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
+static struct waitqueue*
+waitq(void *chan)
+{
+  // Multiplicative hash; the top bits mix in all of the address.
+  return &ptable.waitq[((uint)chan * 0x9E3779B1) >> (32 - WAITQ_SHIFT)];
+}
+
+// Append p to the wait queue for p->chan.
+// ptable.lock must be held.
+static void
+waitq_add(struct proc *p)
+{
+  struct waitqueue *wq = waitq(p->chan);
+
+  p->wqnext = 0;
+  p->wqprev = wq->tail;
+  if(wq->tail)
+    wq->tail->wqnext = p;
+  else
+    wq->head = p;
+  wq->tail = p;
+}
+
+// Take sleeping p off its wait queue and make it RUNNABLE.
+// ptable.lock must be held.
+static void
+waitq_wake(struct proc *p)
+{
+  struct waitqueue *wq = waitq(p->chan);
+
+  if(p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    wq->head = p->wqnext;
+  if(p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  else
+    wq->tail = p->wqprev;
+  p->wqnext = p->wqprev = 0;
+  p->chan = 0;
+  p->state = RUNNABLE;
+}
+
 void
 pinit(void)
 {
+  struct proc *p;
+
   initlock(&ptable.lock, "ptable");
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    initlock(&p->lock, "proc");
 }
 
 // Must be called with interrupts disabled
@@ -33,38 +92,44 @@ cpuid() {
 }
 
 // Must be called with interrupts disabled to avoid the caller being
-// rescheduled between reading lapicid and running through the loop.
+// rescheduled to another CPU while it uses the result.
+// seginit() points %gs at this CPU's struct cpu.
 struct cpu*
 mycpu(void)
 {
-  int apicid, i;
-  
+  struct cpu *c;
+
   if(readeflags()&FL_IF)
     panic("mycpu called with interrupts enabled\n");
-  
-  apicid = lapicid();
-  // APIC IDs are not guaranteed to be contiguous. Maybe we should have
-  // a reverse map, or reserve a register to store &cpus[i].
-  for (i = 0; i < ncpu; ++i) {
-    if (cpus[i].apicid == apicid)
-      return &cpus[i];
-  }
-  panic("unknown apicid\n");
+  asm volatile("movl %%gs:0, %0" : "=r" (c));
+  return c;
 }
 
-// Disable interrupts so that we are not rescheduled
-// while reading proc from the cpu structure
+// Read proc from the cpu structure in a single load, so
+// being rescheduled around it does no harm: any CPU we run
+// on has us as its proc.
 struct proc*
 myproc(void) {
-  struct cpu *c;
   struct proc *p;
-  pushcli();
-  c = mycpu();
-  p = c->proc;
-  popcli();
+
+  asm volatile("movl %%gs:4, %0" : "=r" (p));
   return p;
 }
 
+// Return slot p to UNUSED. kill() reads pid without ptable.lock,
+// so pid and killed change under p->lock.
+static void
+freeslot(struct proc *p)
+{
+  acquire(&p->lock);
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->state = UNUSED;
+  release(&p->lock);
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -86,14 +151,16 @@ allocproc(void)
   return 0;
 
 found:
+  acquire(&p->lock);
   p->state = EMBRYO;
   p->pid = nextpid++;
+  release(&p->lock);
 
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    freeslot(p);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -163,9 +230,12 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // 주소 공간만 잡아 두고 page는 처음 쓸 때 할당 (vm.c: lazyfault)
+    if(sz + n >= KERNBASE || sz + n < sz)
       return -1;
+    sz += n;
   } else if(n < 0){
+    lazyrelease(curproc->pgdir, sz + n, sz);
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   }
@@ -193,7 +263,7 @@ fork(void)
   if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
     kfree(np->kstack);
     np->kstack = 0;
-    np->state = UNUSED;
+    freeslot(np);
     return -1;
   }
   np->sz = curproc->sz;
@@ -289,12 +359,9 @@ wait(void)
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
+        lazyrelease(p->pgdir, 0, p->sz);
         freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
+        freeslot(p);
         release(&ptable.lock);
         return pid;
       }
@@ -438,6 +505,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  waitq_add(p);
 
   sched();
 
@@ -451,6 +519,43 @@ sleep(void *chan, struct spinlock *lk)
   }
 }
 
+// Timer function for sleep_timeout(): wake p if it is still asleep.
+static void
+sleep_expired(void *arg)
+{
+  struct proc *p = arg;
+
+  acquire(&ptable.lock);
+  if(p->state == SLEEPING)
+    waitq_wake(p);
+  release(&ptable.lock);
+}
+
+// Like sleep(), but also wake up after n ticks. Returns 0 if
+// the timeout expired, 1 if woken (or killed) before that.
+int
+sleep_timeout(void *chan, struct spinlock *lk, uint n)
+{
+  struct timer t;
+  int pending;
+
+  if(lk != &ptable.lock){
+    acquire(&ptable.lock);
+    release(lk);
+  }
+  // Armed under ptable.lock, so it cannot fire before we sleep.
+  t.expires = ticks + n;
+  t.func = sleep_expired;
+  t.arg = myproc();
+  add_timer(&t);
+  sleep(chan, &ptable.lock);
+  // del_timer() may wait for sleep_expired(), which takes ptable.lock.
+  release(&ptable.lock);
+  pending = del_timer(&t);
+  acquire(lk);
+  return pending;
+}
+
 //PAGEBREAK!
 // Wake up all processes sleeping on chan.
 // The ptable lock must be held.
@@ -459,9 +564,13 @@ wakeup1(void *chan)
 {
   struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  struct proc *next;
+
+  for(p = waitq(chan)->head; p; p = next){
+    next = p->wqnext;
+    if(p->chan == chan)
+      waitq_wake(p);
+  }
 }
 
 // Wake up all processes sleeping on chan.
@@ -473,26 +582,56 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Wake up only the longest sleeper on chan. For channels
+// where any one waiter can use what the caller freed and
+// waking the rest would just send them back to sleep.
+void
+wakeup_one(void *chan)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = waitq(chan)->head; p; p = p->wqnext){
+    if(p->chan == chan){
+      waitq_wake(p);
+      break;
+    }
+  }
+  release(&ptable.lock);
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
+// The scan takes no global lock; ptable.lock is only needed
+// to wake the process if it is sleeping.
 int
 kill(int pid)
 {
   struct proc *p;
 
-  acquire(&ptable.lock);
+  if(pid <= 0)
+    return -1;
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+    if(p->pid != pid)
+      continue;
+    acquire(&p->lock);
+    if(p->pid != pid || p->state == UNUSED){
+      // Freed or reused since we looked.
+      release(&p->lock);
+      continue;
+    }
+    p->killed = 1;
+    release(&p->lock);
+    // Wake process from sleep if necessary.
+    if(p->state == SLEEPING){
+      acquire(&ptable.lock);
+      if(p->pid == pid && p->state == SLEEPING)
+        waitq_wake(p);
       release(&ptable.lock);
-      return 0;
     }
+    return 0;
   }
-  release(&ptable.lock);
   return -1;
 }
 
@@ -531,4 +670,5 @@ procdump(void)
     }
     cprintf("\n");
   }
+  latencydump();
 }
@@ -1,5 +1,7 @@
 // Per-CPU state
 struct cpu {
+  struct cpu *self;            // This struct, at %gs:0 (mycpu)
+  struct proc *proc;           // The process running on this cpu or null, at %gs:4
   uchar apicid;                // Local APIC ID
   struct context *scheduler;   // swtch() here to enter scheduler
   struct taskstate ts;         // Used by x86 to find stack for interrupt
@@ -7,7 +9,13 @@ struct cpu {
   volatile uint started;       // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
-  struct proc *proc;           // The process running on this cpu or null
+#ifdef LATENCYTRACE
+  uint64 np_start;             // TSC when this CPU last became non-preemptible
+  uint np_pcs[10];             //   and the call stack there (spinlock.c)
+  uint64 np_max;               // Longest non-preemptible section so far
+  uint np_max_start[10];       //   where it began
+  uint np_max_end[10];         //   and where it ended
+#endif
 };
 
 extern struct cpu cpus[NCPU];
@@ -36,6 +44,7 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
+  struct spinlock lock;        // Guards pid and killed
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
@@ -49,6 +58,8 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct proc *wqnext;         // Wait queue links while SLEEPING
+  struct proc *wqprev;
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -6,8 +6,8 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 
 void
@@ -17,17 +17,36 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
 }
 
+// Buffer and inode locks are mostly held briefly, so while the
+// holder is running on another CPU, spin for it up to SPIN_LIMIT
+// pauses before going to sleep, which costs two context switches.
+// The owner is read without lk->lk; a struct proc is always a
+// struct proc, so at worst we misjudge and sleep or spin a bit.
+#define SPIN_LIMIT 2000
+
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *owner;
+  int spins;
+
+  for (spins = 0; lk->locked && spins < SPIN_LIMIT; spins++) {
+    owner = lk->owner;
+    if (owner == 0 || owner->state != RUNNING)
+      break;
+    pause();
+  }
+
   acquire(&lk->lk);
   while (lk->locked) {
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->owner = myproc();
   release(&lk->lk);
 }
 
@@ -37,6 +56,7 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
   wakeup(lk);
   release(&lk->lk);
 }
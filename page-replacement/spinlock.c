@@ -6,15 +6,106 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "lockstat.h"
+
+// Waiting is FIFO: acquire() takes a ticket from next and spins
+// until owner reaches it, and release() serves the next ticket.
+// Each waiter pauses in proportion to how many are ahead of it, so
+// a release doesn't send every waiter at the cache line at once.
+#define BACKOFF 50 // pauses per waiter ahead
+
+#ifdef LOCKSTAT
+// Contention counters by lock name, kept per CPU so that only the
+// CPU holding a lock updates them, with interrupts off.
+struct lockcount {
+  uint acquire;
+  uint contended;
+  uint64 spin;
+  uint64 maxhold;
+};
+
+static struct {
+  char *name;
+  struct lockcount cpu[NCPU];
+} lockstats[NLOCKSTAT];
+static int nlockstat;
+static uint lockstat_busy; // Guards adding to lockstats[]
+
+// Index of name's counters in lockstats[], or -1 if full.
+// initlock() runs before mpinit() and seginit() (kinit1), when
+// mycpu() cannot work yet, so this only turns interrupts off
+// rather than pushcli().
+static int
+lockstat_class(char *name)
+{
+  uint eflags;
+  int i;
+
+  eflags = readeflags();
+  cli();
+  while(xchg(&lockstat_busy, 1) != 0)
+    pause();
+  for(i = 0; i < nlockstat; i++)
+    if(strncmp(lockstats[i].name, name, LOCKNAMESZ) == 0)
+      break;
+  if(i == nlockstat){
+    if(i < NLOCKSTAT){
+      lockstats[i].name = name;
+      nlockstat++;
+    } else
+      i = -1;
+  }
+  xchg(&lockstat_busy, 0);
+  if(eflags & FL_IF)
+    sti();
+  return i;
+}
+
+// Copy the counters of up to n lock names, summed over CPUs, to
+// user address addr. Returns the number copied, or -1.
+int
+lockstat(uint addr, int n)
+{
+  struct lockstat st;
+  struct lockcount *c;
+  int i, j;
+
+  for(i = 0; i < nlockstat && i < n; i++){
+    memset(&st, 0, sizeof(st));
+    safestrcpy(st.name, lockstats[i].name, sizeof(st.name));
+    for(j = 0; j < ncpu; j++){
+      c = &lockstats[i].cpu[j];
+      st.acquire += c->acquire;
+      st.contended += c->contended;
+      st.spin += c->spin;
+      if(c->maxhold > st.maxhold)
+        st.maxhold = c->maxhold;
+    }
+    if(copyout(myproc()->pgdir, addr + i * sizeof(st), &st, sizeof(st)) < 0)
+      return -1;
+  }
+  return i;
+}
+#else
+int
+lockstat(uint addr, int n)
+{
+  return -1;
+}
+#endif
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->stat = lockstat_class(name);
+#endif
 }
 
 // Acquire the lock.
@@ -24,13 +115,27 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, ahead, i;
+#ifdef LOCKSTAT
+  struct lockcount *c;
+  uint64 start = 0;
+#endif
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The xadd is atomic.
+  ticket = xadd(&lk->next, 1);
+  if((ahead = ticket - lk->owner) != 0){
+#ifdef LOCKSTAT
+    start = rdtsc();
+#endif
+    do {
+      for(i = ahead * BACKOFF; i > 0; i--)
+        pause();
+    } while((ahead = ticket - lk->owner) != 0);
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -39,17 +144,41 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
+#ifdef LOCKSTAT
   getcallerpcs(&lk, lk->pcs);
+  lk->hold_start = rdtsc();
+  if(lk->stat >= 0){
+    c = &lockstats[lk->stat].cpu[cpuid()];
+    c->acquire++;
+    if(start){
+      c->contended++;
+      c->spin += lk->hold_start - start;
+    }
+  }
+#endif
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+#ifdef LOCKSTAT
+  struct lockcount *c;
+  uint64 hold;
+#endif
+
   if(!holding(lk))
     panic("release");
 
+#ifdef LOCKSTAT
+  if(lk->stat >= 0){
+    hold = rdtsc() - lk->hold_start;
+    c = &lockstats[lk->stat].cpu[cpuid()];
+    if(hold > c->maxhold)
+      c->maxhold = hold;
+  }
   lk->pcs[0] = 0;
+#endif
   lk->cpu = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
@@ -59,10 +188,9 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Serve the next ticket. Only the holder writes owner, so this
+  // needn't be locked, but it must be a single store.
+  asm volatile("movl %1, %0" : "=m" (lk->owner) : "r" (lk->owner + 1));
 
   popcli();
 }
@@ -91,15 +219,70 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->owner != lock->next && lock->cpu == mycpu();
   popcli();
   return r;
 }
 
 
+#ifdef LATENCYTRACE
+// Non-preemptible sections: the CPU stops being preemptible at
+// np_begin() and is again at np_end(). Keep the longest one per CPU.
+// v is as for getcallerpcs(), in pushcli() or popcli().
+static void
+np_begin(struct cpu *c, void *v)
+{
+  c->np_start = rdtsc();
+  getcallerpcs(v, c->np_pcs);
+}
+
+static void
+np_end(struct cpu *c, void *v)
+{
+  uint64 len = rdtsc() - c->np_start;
+
+  if(len > c->np_max){
+    c->np_max = len;
+    memmove(c->np_max_start, c->np_pcs, sizeof(c->np_pcs));
+    getcallerpcs(v, c->np_max_end);
+  }
+}
+
+// Print, and start over, each CPU's longest non-preemptible
+// section, with the call stacks where it began and ended.
+// Called from procdump(); no lock, like it.
+void
+latencydump(void)
+{
+  struct cpu *c;
+  int i;
+
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    if(c->np_max == 0)
+      continue;
+    cprintf("cpu%d: non-preemptible for %d Kcycles\n  from", c - cpus,
+            (uint)(c->np_max >> 10));
+    for(i = 0; i < 10 && c->np_max_start[i] != 0; i++)
+      cprintf(" %p", c->np_max_start[i]);
+    cprintf("\n  to  ");
+    for(i = 0; i < 10 && c->np_max_end[i] != 0; i++)
+      cprintf(" %p", c->np_max_end[i]);
+    cprintf("\n");
+    c->np_max = 0;
+  }
+}
+#else
+void
+latencydump(void)
+{
+}
+#endif
+
 // Pushcli/popcli are like cli/sti except that they are matched:
 // it takes two popcli to undo two pushcli.  Also, if interrupts
 // are off, then pushcli, popcli leaves them off.
+// The CPU is not preemptible while ncli > 0; a timer interrupt
+// that came in meanwhile is taken, and yields, at the final popcli.
 
 void
 pushcli(void)
@@ -111,6 +294,10 @@ pushcli(void)
   if(mycpu()->ncli == 0)
     mycpu()->intena = eflags & FL_IF;
   mycpu()->ncli += 1;
+#ifdef LATENCYTRACE
+  if(mycpu()->ncli == 1)
+    np_begin(mycpu(), (uint*)__builtin_frame_address(0) + 2);
+#endif
 }
 
 void
@@ -120,6 +307,10 @@ popcli(void)
     panic("popcli - interruptible");
   if(--mycpu()->ncli < 0)
     panic("popcli");
+#ifdef LATENCYTRACE
+  if(mycpu()->ncli == 0)
+    np_end(mycpu(), (uint*)__builtin_frame_address(0) + 2);
+#endif
   if(mycpu()->ncli == 0 && mycpu()->intena)
     sti();
 }
@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
@@ -65,6 +66,10 @@ argptr(int n, char **pp, int size)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  // The kernel may write the buffer with locks held (e.g. pipes),
+  // so fault in any untouched heap pages and copy COW pages now.
+  if(lazyfault_range(curproc, i, size) < 0)
+    return -1;
   *pp = (char*)i;
   return 0;
 }
@@ -106,6 +111,8 @@ extern int sys_uptime(void);
 extern int sys_swapread(void);
 extern int sys_swapwrite(void);
 extern int sys_swapstat(void);
+extern int sys_lockstat(void);
+extern int sys_untouched(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -132,6 +139,8 @@ static int (*syscalls[])(void) = {
 [SYS_swapread]	sys_swapread,
 [SYS_swapwrite] sys_swapwrite,
 [SYS_swapstat] sys_swapstat,
+[SYS_lockstat] sys_lockstat,
+[SYS_untouched] sys_untouched,
 };
 
 void
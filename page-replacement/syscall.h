@@ -23,3 +23,5 @@
 #define SYS_swapread	22
 #define SYS_swapwrite	23
 #define SYS_swapstat	24
+#define SYS_lockstat	25
+#define SYS_untouched	26
@@ -5,7 +5,9 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
+#include "lockstat.h"
 
 int
 sys_fork(void)
@@ -71,7 +73,7 @@ sys_sleep(void)
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    sleep_timeout(&ticks, &tickslock, n - (ticks - ticks0));
   }
   release(&tickslock);
   return 0;
@@ -89,3 +91,28 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// copy the lock contention statistics to the user's buffer.
+int
+sys_lockstat(void)
+{
+  char *buf;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  // 이름은 NLOCKSTAT개까지만 (크기 계산 overflow 방지)
+  if(n > NLOCKSTAT)
+    n = NLOCKSTAT;
+  if(argptr(0, &buf, n * sizeof(struct lockstat)) < 0)
+    return -1;
+  return lockstat((uint)buf, n);
+}
+
+// number of heap pages sbrk reserved and gave back
+// without their ever being touched.
+int
+sys_untouched(void)
+{
+  return untouched;
+}
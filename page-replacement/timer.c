@@ -0,0 +1,165 @@
+// Hierarchical timer wheel.
+//
+// Pending timers hang off the slots of four wheels. The first wheel
+// has one slot per tick for the next TVR_SIZE ticks; each further
+// wheel has TVN_SIZE slots, each covering one full turn of the wheel
+// below it. Whenever the first wheel wraps around, the next slot of
+// the second wheel is cascaded down into it, and so on upwards.
+// Adding, deleting and expiring a timer take constant time, and a
+// timer is rehashed at most once per wheel on its way down.
+//
+// CPU 0 calls run_timers() after every tick. Expired timers' functions
+// run in interrupt context without the wheel lock held, so they may
+// take other locks but must not sleep.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "timer.h"
+
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define NTVN 3
+// Farthest ahead a timer can be set; later ones fire at this.
+#define MAX_TIMEOUT ((1 << (TVR_BITS + NTVN * TVN_BITS)) - 1)
+
+// Slot of wheel n the clock is in.
+#define INDEX(n) ((wheel.clk >> (TVR_BITS + (n) * TVN_BITS)) & TVN_MASK)
+
+struct {
+  struct spinlock lock;
+  uint clk;              // Next tick to expire
+  struct timer *running; // Timer whose func is being called
+  struct timer *tv1[TVR_SIZE];
+  struct timer *tvn[NTVN][TVN_SIZE];
+} wheel;
+
+static void
+slot_add(struct timer **slot, struct timer *t)
+{
+  t->next = *slot;
+  if(*slot)
+    (*slot)->pprev = &t->next;
+  t->pprev = slot;
+  *slot = t;
+}
+
+static void
+slot_del(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+// Hang t in the slot for t->expires as seen from wheel.clk.
+static void
+internal_add(struct timer *t)
+{
+  uint expires = t->expires;
+  uint idx = expires - wheel.clk;
+  int i;
+
+  if((int)idx < 0) {
+    // Already due: expire with the next tick processed.
+    slot_add(&wheel.tv1[wheel.clk & TVR_MASK], t);
+    return;
+  }
+  if(idx < TVR_SIZE) {
+    slot_add(&wheel.tv1[expires & TVR_MASK], t);
+    return;
+  }
+  if(idx > MAX_TIMEOUT) {
+    expires = wheel.clk + MAX_TIMEOUT;
+    idx = MAX_TIMEOUT;
+  }
+  for(i = 0; i < NTVN - 1; i++)
+    if(idx < 1 << (TVR_BITS + (i + 1) * TVN_BITS))
+      break;
+  slot_add(&wheel.tvn[i][(expires >> (TVR_BITS + i * TVN_BITS)) & TVN_MASK], t);
+}
+
+// Redistribute the timers in slot index of wheel n
+// over the wheels below it.
+static int
+cascade(int n, int index)
+{
+  struct timer *t, *next;
+
+  t = wheel.tvn[n][index];
+  wheel.tvn[n][index] = 0;
+  for(; t; t = next) {
+    next = t->next;
+    internal_add(t);
+  }
+  return index;
+}
+
+void
+timerinit(void)
+{
+  initlock(&wheel.lock, "timer");
+  wheel.clk = ticks;
+}
+
+// Arm t to call t->func(t->arg) at tick t->expires.
+// t must not already be pending.
+void
+add_timer(struct timer *t)
+{
+  acquire(&wheel.lock);
+  internal_add(t);
+  release(&wheel.lock);
+}
+
+// Disarm t. If t's func is running on another CPU, wait for it
+// to return, so that t may be freed afterwards; so don't call
+// this from t's own func. Returns 1 if t was still pending.
+int
+del_timer(struct timer *t)
+{
+  int pending;
+
+  acquire(&wheel.lock);
+  while(wheel.running == t) {
+    release(&wheel.lock);
+    acquire(&wheel.lock);
+  }
+  pending = t->pprev != 0;
+  if(pending)
+    slot_del(t);
+  release(&wheel.lock);
+  return pending;
+}
+
+// Expire every timer due up to the current tick.
+void
+run_timers(void)
+{
+  struct timer *t;
+  int index;
+
+  acquire(&wheel.lock);
+  while((int)(ticks - wheel.clk) >= 0) {
+    index = wheel.clk & TVR_MASK;
+    if(index == 0 && cascade(0, INDEX(0)) == 0 && cascade(1, INDEX(1)) == 0)
+      cascade(2, INDEX(2));
+    wheel.clk++;
+    while((t = wheel.tv1[index]) != 0) {
+      slot_del(t);
+      wheel.running = t;
+      release(&wheel.lock);
+      t->func(t->arg);
+      acquire(&wheel.lock);
+      wheel.running = 0;
+    }
+  }
+  release(&wheel.lock);
+}
@@ -0,0 +1,9 @@
+// Kernel timer. Fill in expires, func and arg, then add_timer();
+// func(arg) runs from the timer interrupt once ticks reaches expires.
+struct timer {
+  struct timer *next;   // Wheel slot links
+  struct timer **pprev; // 0 when not pending
+  uint expires;         // Tick to fire at
+  void (*func)(void*);
+  void *arg;
+};
@@ -3,10 +3,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -51,8 +51,8 @@ trap(struct trapframe *tf)
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
-      wakeup(&ticks);
       release(&tickslock);
+      run_timers();
     }
     lapiceoi();
     break;
@@ -78,7 +78,7 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
   case T_PGFLT:
-    if(page_fault_hadler(myproc()->pgdir,rcr2()))
+    if(myproc() && page_fault_hadler(myproc()->pgdir, rcr2(), tf->err & 2))
       break;
   // PAGEBREAK: 13
   default:
@@ -113,17 +113,26 @@ trap(struct trapframe *tf)
     exit();
 }
 
-int page_fault_hadler(pde_t* pgdir, uint vaddr)
+int page_fault_hadler(pde_t* pgdir, uint vaddr, int write)
 {
   uint *pte;
 
-  //1. Swap out된거 때문에 발생한 page fault인지 확인해야한다.
+  if(vaddr >= KERNBASE)
+    return 0;
   pte = walkpgdir(pgdir, (char *)PGROUNDDOWN(vaddr),0);
-  if(*pte == 0)
+  // sbrk로 잡아만 두고 아직 안 쓴 heap page
+  if(pte == 0 || *pte == 0)
+    return lazyfault(myproc(), vaddr);
+  //0. COW page에 쓰기
+  if(*pte & PTE_P)
   {
+    if(write && (*pte & PTE_COW))
+      return cow_fault(pgdir, PGROUNDDOWN(vaddr), pte);
     return 0;
   }
 
+  //1. 여기까지 오면 Swap out된거 때문에 발생한 page fault
+
   //2. Swap in 시키기 위해 새로운 페이지 생성
   char *new_page = kalloc();
   if(new_page == 0){
@@ -135,10 +144,11 @@ int page_fault_hadler(pde_t* pgdir, uint vaddr)
   //3. swap space에서 읽어오기
   int swap_index = *pte >> 12;
   swapread(new_page, swap_index);
-  clear_bit(swap_index);
+  swap_put(swap_index); // COW로 공유 중이면 slot은 남는다
 
   //4. PTE Update + PTE_P set
   *pte = pa | PTE_FLAGS(*pte) | PTE_P;
+  append_lru(pgdir, PGROUNDDOWN(vaddr), pa);
 
   //5. Flush
   flush();
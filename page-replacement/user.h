@@ -1,5 +1,6 @@
 struct stat;
 struct rtcdate;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -26,6 +27,8 @@ int uptime(void);
 void swapread(const char*, int);
 void swapwrite(const char*, int);
 void swapstat(int*, int*);
+int lockstat(struct lockstat*, int);
+int untouched(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "lockstat.h"
 
 char buf[8192];
 char name[3];
@@ -1724,6 +1725,49 @@ uio()
   printf(1, "uio test done\n");
 }
 
+// fork() shares pages copy-on-write. A child's writes into a buffer
+// it inherited, done by the kernel (lockstat's copyout, a pipe read
+// with the pipe lock held), must copy the page and leave the parent's
+// copy alone.
+struct lockstat cowstat[4];
+
+void
+cowtest(void)
+{
+  int fds[2], pid, i;
+  char *p;
+
+  printf(stdout, "cow test\n");
+  memset(cowstat, 'x', sizeof(cowstat));
+  if(pipe(fds) != 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[1]);
+    lockstat(cowstat, 4); // -1 unless built with LOCKSTAT=1
+    read(fds[0], (char*)cowstat + sizeof(cowstat) - 8, 8);
+    exit();
+  }
+  close(fds[0]);
+  write(fds[1], "childbuf", 8);
+  close(fds[1]);
+  wait();
+  p = (char*)cowstat;
+  for(i = 0; i < sizeof(cowstat); i++){
+    if(p[i] != 'x'){
+      printf(stdout, "cow test: child changed parent's byte %d\n", i);
+      exit();
+    }
+  }
+  printf(stdout, "cow test ok\n");
+}
+
 void argptest()
 {
   int fd;
@@ -1793,6 +1837,7 @@ main(int argc, char *argv[])
   dirfile();
   iref();
   forktest();
+  cowtest();
   bigdir(); // slow
 
   uio();
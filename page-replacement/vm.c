@@ -4,6 +4,7 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "elf.h"
 
@@ -20,12 +21,21 @@ void seginit(void)
   // Cannot share a CODE descriptor for both kernel and user
   // because it would have to have DPL_USR, but the CPU forbids
   // an interrupt from CPL=0 to DPL=3.
-  c = &cpus[cpuid()];
+  // %gs isn't set up yet, so mycpu() can't be used: find this
+  // CPU by its APIC ID.
+  for (c = cpus; c < &cpus[ncpu] && c->apicid != lapicid(); c++)
+    ;
+  if (c == &cpus[ncpu])
+    panic("seginit: unknown apicid");
   c->gdt[SEG_KCODE] = SEG(STA_X | STA_R, 0, 0xffffffff, 0);
   c->gdt[SEG_KDATA] = SEG(STA_W, 0, 0xffffffff, 0);
   c->gdt[SEG_UCODE] = SEG(STA_X | STA_R, 0, 0xffffffff, DPL_USER);
   c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
+  // Per-CPU data: %gs:0 is c->self, %gs:4 is c->proc (mycpu, myproc).
+  c->gdt[SEG_KCPU] = SEG(STA_W, c, sizeof(*c), 0);
   lgdt(c->gdt, sizeof(c->gdt));
+  c->self = c;
+  loadgs(SEG_KCPU << 3);
 }
 
 // Return the address of the PTE in page table pgdir
@@ -273,29 +283,17 @@ int deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char *)a, 0);
     if (!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if ((*pte & PTE_P) != 0 || *pte != 0)
+    else if (*pte != 0)
     {
-      pa = PTE_ADDR(*pte);
-      if (pa == 0)
-      { // swap 당했으면?
-        int swap_index = PTE_ADDR(*pte) >> 12;
-        clear_bit(swap_index);
+      if (!(*pte & PTE_P))
+      { // swap 당했으면? (COW로 공유 중일 수 있으니 reference만 놓기)
+        swap_put(*pte >> 12);
       }
       else
       { // swap 안당했으면?
-        char *v = P2V(pa);
-        struct page *targetPage = page_lru_head;
-        do
-        {
-          if (targetPage == 0)
-            break;
-          if (targetPage->vaddr == (char *)a && targetPage->pgdir == pgdir)
-          {
-            pop_lru(pa);
-          }
-          targetPage = targetPage->next;
-        } while (targetPage != page_lru_head);
-        kfree(v);
+        pa = PTE_ADDR(*pte);
+        drop_lru(pgdir, a, pa);
+        page_put(pa);
       }
       *pte = 0;
     }
@@ -303,6 +301,87 @@ int deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// sbrk() only reserves address space (growproc); a heap page is
+// allocated and zeroed when first touched (lazyfault). untouched
+// counts the reserved pages given back, by sbrk() or along with the
+// whole address space, without ever having been touched. A PTE of
+// 0 below p->sz means such a page; a swapped-out page has a slot.
+uint untouched;
+
+// Map a zeroed page at va if it is a reserved heap page of p that
+// was never touched. Returns 1 if it did, 0 otherwise.
+int lazyfault(struct proc *p, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  if (va >= p->sz)
+    return 0;
+  pte = walkpgdir(p->pgdir, (char *)va, 0);
+  if (pte && *pte != 0)
+    return 0;
+  if ((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  if (mappages(p->pgdir, (char *)va, PGSIZE, V2P(mem), PTE_W | PTE_U) < 0)
+  {
+    kfree(mem);
+    return 0;
+  }
+  append_lru(p->pgdir, va, V2P(mem));
+  return 1;
+}
+
+// Touch the reserved heap pages of p in [va, va + n) and copy the
+// COW pages there, so the kernel can then write them with locks held
+// (argptr) without a page fault that would allocate, and maybe swap.
+// Returns -1 if out of memory.
+int lazyfault_range(struct proc *p, uint va, uint n)
+{
+  pte_t *pte;
+  uint a;
+
+  for (a = PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+  {
+    pte = walkpgdir(p->pgdir, (char *)a, 0);
+    if (pte == 0 || *pte == 0)
+    {
+      if (!lazyfault(p, a))
+        return -1;
+    }
+    else if ((*pte & (PTE_P | PTE_COW)) == (PTE_P | PTE_COW) &&
+             !cow_fault(p->pgdir, a, pte))
+      return -1;
+  }
+  return 0;
+}
+
+// Add the never touched reserved pages in [lo, hi) to untouched.
+// Call before the pages go away.
+void lazyrelease(pde_t *pgdir, uint lo, uint hi)
+{
+  pte_t *pte;
+  uint a, next, n = 0;
+
+  for (a = PGROUNDUP(lo); a < hi; a += PGSIZE)
+  {
+    pte = walkpgdir(pgdir, (char *)a, 0);
+    if (pte == 0)
+    {
+      // page table째로 없음 -> 다음 page table까지 다 안 쓴 page
+      next = PGADDR(PDX(a) + 1, 0, 0);
+      if (next > hi)
+        next = PGROUNDUP(hi);
+      n += (next - a) / PGSIZE;
+      a = next - PGSIZE;
+    }
+    else if (*pte == 0)
+      n++;
+  }
+  __sync_fetch_and_add(&untouched, n);
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void freevm(pde_t *pgdir)
@@ -336,52 +415,36 @@ void clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child. Pages are shared copy-on-write rather than
+// copied: a writable page becomes read-only with PTE_COW in both
+// page tables, and the first write copies it (trap.c: cow_fault).
+// A swapped-out page is shared the same way, by its swap slot.
 pde_t *
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
-  uint pa, i, flags;
-  char *mem;
+  pte_t *pte, *npte;
+  uint i;
 
   if ((d = setupkvm()) == 0)
     return 0;
   for (i = 0; i < sz; i += PGSIZE)
   {
-    if ((pte = walkpgdir(pgdir, (void *)i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-
-    if (!(*pte & PTE_P)) // Swap space라면?
-    {
-      if ((mem = kalloc()) == 0)
-        goto bad;
-      swapread(mem, *pte >> 12);
-      flags = PTE_FLAGS(*pte) | PTE_P;
-      if (mappages(d, (void *)i, PGSIZE, V2P(mem), flags) < 0)
-      {
-        kfree(mem);
-        goto bad;
-      }
-      append_lru(d, (char *)i, V2P(mem));
+    // 아직 안 쓴 heap page는 자식도 처음 쓸 때 할당
+    if ((pte = walkpgdir(pgdir, (void *)i, 0)) == 0 || *pte == 0)
       continue;
-    }
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    if ((mem = kalloc()) == 0)
+    if ((npte = walkpgdir(d, (void *)i, 1)) == 0)
       goto bad;
-    memmove(mem, (char *)P2V(pa), PGSIZE);
-    if (mappages(d, (void *)i, PGSIZE, V2P(mem), flags) < 0)
-    {
-      kfree(mem);
-      goto bad;
-    }
-    append_lru(d, (char *)i, V2P(mem));
+    // 쓰기 가능한 page는 부모, 자식 둘 다 읽기 전용 + COW로 (kalloc.c)
+    cow_share(pte, npte);
   }
+  // 부모 PTE에서 PTE_W를 뺐으니 TLB flush
+  flush();
   return d;
 
 bad:
   freevm(d);
+  flush();
   return 0;
 }
 
@@ -393,7 +456,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if ((*pte & PTE_P) == 0)
+  if (pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if ((*pte & PTE_U) == 0)
     return 0;
@@ -403,15 +466,22 @@ uva2ka(pde_t *pgdir, char *uva)
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
 // uva2ka ensures this only works for PTE_U pages.
+// The copy goes through the kernel mapping of the page, which does not
+// fault on a read-only PTE, so a COW page is copied here first.
 int copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
   char *buf, *pa0;
   uint n, va0;
+  pte_t *pte;
 
   buf = (char *)p;
   while (len > 0)
   {
     va0 = (uint)PGROUNDDOWN(va);
+    pte = walkpgdir(pgdir, (char *)va0, 0);
+    if (pte && (*pte & (PTE_P | PTE_COW)) == (PTE_P | PTE_COW) &&
+        !cow_fault(pgdir, va0, pte))
+      return -1;
     pa0 = uva2ka(pgdir, (char *)va0);
     if (pa0 == 0)
       return -1;
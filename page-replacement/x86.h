@@ -130,6 +130,35 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add val to *addr, returning the old value.
+static inline uint
+xadd(volatile uint *addr, uint val)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (val), "+m" (*addr) :
+               :
+               "memory", "cc");
+  return val;
+}
+
+// Spin-wait hint, so a waiting CPU eases off the memory bus.
+// Also makes the compiler reread memory in the wait loop.
+static inline void
+pause(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
+// Read the time-stamp counter.
+static inline uint64
+rdtsc(void)
+{
+  uint64 val;
+
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 static inline uint
 rcr2(void)
 {